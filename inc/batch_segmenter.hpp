@@ -0,0 +1,44 @@
+#ifndef BATCH_SEGMENTER_HPP
+#define BATCH_SEGMENTER_HPP
+
+#include <string>
+#include <vector>
+
+#include "filter_program.hpp"
+#include "frame_segmenter.hpp"
+
+/** Options of a headless batch run */
+struct BatchOptions {
+	std::string poly_dir; // Directory for <stem>.wkt polygons, empty to disable
+	std::string overlay_dir; // Directory for overlays with the input file name, empty to disable
+	int threads = 0; // 0 for one per hardware thread
+	int pyramid_level = 0; // Passed to FilterProgram::rasterize()
+	SegmentOptions segment;
+};
+
+/** Counters of a batch run */
+struct BatchSummary {
+	size_t processed = 0;
+	size_t unreadable = 0; // Could not be decoded
+	size_t rejected = 0; // Filter does not fit the image size
+	size_t empty = 0; // No contour found
+	size_t write_errors = 0;
+};
+
+/** Lists the images of a batch. A directory is scanned (not recursively) for
+ * files with a known image extension; any other path is read as a list file
+ * with one image per line. Returns an empty vector on error.
+ */
+std::vector<std::string> listImages(const std::string& path);
+
+/** Segments every image on a pool of opts.threads workers, writing one
+ * polygon and optionally one overlay per image. Never opens a window.
+ * Images that share a stem with another, such as images of the same name in
+ * different directories of a list file, are output under their whole path
+ * with separators and dots replaced by '_'.
+ * Images of different sizes are supported: the filter is rasterized once per
+ * size. Problems with single images are reported and counted, not fatal.
+ */
+BatchSummary runBatch(const FilterProgram& filter, const std::vector<std::string>& images, const BatchOptions& opts);
+
+#endif
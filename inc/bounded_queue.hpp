@@ -0,0 +1,69 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/** Blocking FIFO with a fixed capacity, to hand frames between threads while
+ * keeping memory flat. push() blocks while the queue is full, pop() while it is
+ * empty. After close(), pop() drains what is left and then returns false.
+ */
+template <typename T>
+class BoundedQueue {
+	public:
+		explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+		/** Returns false if the queue was closed */
+		bool push(T item) {
+			std::unique_lock<std::mutex> lock(m);
+			not_full.wait(lock, [this]() { return items.size() < capacity || closed; });
+			if (closed) return false;
+			items.push_back(std::move(item));
+			not_empty.notify_one();
+			return true;
+		}
+
+		/** Returns false once the queue is closed and empty */
+		bool pop(T& item) {
+			std::unique_lock<std::mutex> lock(m);
+			not_empty.wait(lock, [this]() { return !items.empty() || closed; });
+			if (items.empty()) return false;
+			item = std::move(items.front());
+			items.pop_front();
+			not_full.notify_one();
+			return true;
+		}
+
+		/** Same as pop(), without waiting. Returns false if the queue is empty. */
+		bool tryPop(T& item) {
+			std::lock_guard<std::mutex> lock(m);
+			if (items.empty()) return false;
+			item = std::move(items.front());
+			items.pop_front();
+			not_full.notify_one();
+			return true;
+		}
+
+		void close() {
+			std::lock_guard<std::mutex> lock(m);
+			closed = true;
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+
+		size_t size() {
+			std::lock_guard<std::mutex> lock(m);
+			return items.size();
+		}
+
+	private:
+		size_t capacity;
+		bool closed = false;
+		std::deque<T> items;
+		std::mutex m;
+		std::condition_variable not_empty;
+		std::condition_variable not_full;
+};
+
+#endif
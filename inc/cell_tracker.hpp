@@ -0,0 +1,76 @@
+#ifndef CELL_TRACKER_HPP
+#define CELL_TRACKER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Track of one cell, as in the res_track.txt of the Cell Tracking Challenge */
+struct CellTrack {
+	uint32_t id;
+	uint64_t begin; // First and last frame of the track
+	uint64_t end;
+	uint32_t parent; // Track the cell divided from, 0 if none
+};
+
+/** Track of one cell in the frame it was linked in */
+struct CellLink {
+	uint32_t track;
+	uint32_t parent; // Parent track if the track starts here with a division, 0 otherwise
+};
+
+/** Links the cells of consecutive frames into tracks, one frame at a time.
+ *
+ * Each cell is matched to the cell of the previous frame it overlaps most,
+ * by IoU of their filled polygons, if that is at least min_iou. Candidates
+ * are the previous cells whose bounding box overlaps the cell's, found
+ * through a uniform grid over the previous frame, so a frame costs about
+ * linear time in its cells. A previous cell matched by a single cell goes
+ * on in it; matched by several, it divides and each of them starts a track
+ * with it as parent. Cells without any match start tracks of their own.
+ */
+class CellTracker {
+	public:
+		explicit CellTracker(double min_iou = 0.2);
+
+		/** Links the cells of frame, whose contours and bounding boxes are
+		 * given, to those of the previous call. links[k] is the track of
+		 * contours[k].
+		 */
+		void link(uint64_t frame, const std::vector<std::vector<cv::Point>>& contours,
+				const std::vector<cv::Rect>& boxes, std::vector<CellLink>& links);
+
+		/** Every track so far, by ID from 1. Tracks of the last frame linked
+		 * end at it.
+		 */
+		const std::vector<CellTrack>& tracks() const { return all_tracks; }
+
+	private:
+		double min_iou;
+		std::vector<CellTrack> all_tracks;
+
+		//Cells of the previous frame
+		std::vector<std::vector<cv::Point>> prev_contours;
+		std::vector<cv::Rect> prev_boxes;
+		std::vector<uint32_t> prev_tracks;
+
+		//Grid over the previous frame, each bucket listing the cells whose box
+		//reaches it, stored as ranges of one list
+		int grid_size = 1;
+		int grid_cols = 0, grid_rows = 0;
+		std::vector<int> bucket_start;
+		std::vector<int> bucket_cells;
+
+		//Scratch reused from frame to frame
+		std::vector<int> best; // Previous cell matched by each cell, -1 if none
+		std::vector<int> matches; // Cells matching each previous cell
+		std::vector<int> stamp; // Last query that saw each previous cell
+		cv::Mat mask_a, mask_b;
+
+		void buildGrid();
+		double iou(const std::vector<cv::Point>& a, const cv::Rect& box_a,
+				const std::vector<cv::Point>& b, const cv::Rect& box_b);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CHAIN_CODE_HPP
+#define CHAIN_CODE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Freeman chain codes: a contour traced with CHAIN_APPROX_NONE only ever
+ * steps to one of the 8 neighbours of its last vertex, so each step fits in
+ * 3 bits. Directions count counterclockwise from +x, with y pointing down as
+ * in images:
+ *   3 2 1
+ *   4 . 0
+ *   5 6 7
+ */
+
+/** Direction of a step between neighbour pixels, -1 for any other step */
+int chainDirection(cv::Point step);
+
+/** True if every step between consecutive vertices is to a neighbour pixel.
+ * The closing step, from the last vertex back to the first, is not checked.
+ */
+bool isChain(const std::vector<cv::Point>& points);
+
+/** Bytes taken by the codes of a chain of count vertices */
+size_t chainBytes(uint32_t count);
+
+/** Appends the codes of the count - 1 steps of points to buf, 3 bits each
+ * starting at the low bits of the first byte. points must pass isChain().
+ */
+void encodeChain(const std::vector<cv::Point>& points, std::vector<unsigned char>& buf);
+
+/** Decodes count vertices from start and the codes at p, moving p past them.
+ * Returns false if [p, end) is too short.
+ */
+bool decodeChain(const unsigned char*& p, const unsigned char* end, cv::Point start, uint32_t count,
+		std::vector<cv::Point>& points);
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef FILTER_PROGRAM_HPP
+#define FILTER_PROGRAM_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "morphology.hpp"
+
+/** Positional rule ('p'). Marks a single pixel. */
+struct PositionalRule {
+	bool fg;
+	int object; // Object ID of foreground rules, 0 for background
+	cv::Point p;
+};
+
+/** Rectangle rule ('r'). Marks a filled rectangle between two corners. */
+struct RectangleRule {
+	bool fg;
+	int object; // Object ID of foreground rules, 0 for background
+	cv::Point p1;
+	cv::Point p2;
+};
+
+/** HSV rule ('h'). Marks every pixel inside an HSV range, after a number of openings. */
+struct HSVRule {
+	bool fg;
+	int object; // Object ID of foreground rules, 0 for background
+	unsigned short openings;
+	cv::Scalar low;
+	cv::Scalar high;
+};
+
+/** A filter file compiled once into typed rules.
+ *
+ * The file is parsed by load() and the positional and rectangle rules are
+ * rasterized once by rasterize(). After that, execute() only has to run the
+ * HSV rules on each frame and compose them with the fixed layers, in the same
+ * order as they appear on the file.
+ *
+ * HSV rules are classified through a lookup table with one bit per rule for
+ * every 24-bit BGR colour, built with cvtColor/inRange themselves so results
+ * are exact. A frame is then masked in a single pass, without an HSV image or
+ * per rule temporaries (only rules with openings need their own plane).
+ *
+ * Foreground rules may carry an object ID ('f2', 'f3', ...; plain 'f' is
+ * object 1). Foreground pixels get the marker label of the last object that
+ * marked them, so a single watershed separates every object.
+ *
+ * Copies are cheap: the lookup tables are shared, so a copy can be rasterized
+ * for another frame size while the original is in use.
+ */
+class FilterProgram {
+	public:
+		enum class RuleType { POSITIONAL, RECTANGLE, HSV };
+
+		static const int MAX_OBJECTS = 255;
+		static const int FG_THRESHOLD = 200; // Composed values above this are foreground
+
+		/** Watershed marker label of an object. Object 1 keeps the historical
+		 * 255, and every object label is above FG_THRESHOLD.
+		 */
+		static int objectLabel(int object) { return 254 + object; }
+
+		/** Temporaries of execute(), for callers that keep them from frame to
+		 * frame. Not shared between threads.
+		 */
+		struct Scratch {
+			cv::Mat bits; // Matching rules of every pixel, with openings applied
+			cv::Mat plane; // One rule with openings
+			MorphologyBuffers morphology;
+			std::vector<const unsigned char*> values, coverage, objects; // Rows of the fixed layers
+		};
+
+		/** One line of the filter file, pointing into the typed rule vectors */
+		struct Rule {
+			RuleType type;
+			size_t index;
+		};
+
+		std::vector<PositionalRule> positionals;
+		std::vector<RectangleRule> rectangles;
+		std::vector<HSVRule> hsvs;
+		std::vector<Rule> rules; // All rules, in file order
+		int object_count = 1; // Highest object ID used by the filter
+
+		/** Parses a filter file. Errors are written to std::cerr.
+		 * Returns 0 on success, 1 if the file could not be opened, 2 if the
+		 * first char of a line is not 'f' or 'b', 3 on unknown filter types and
+		 * 4 on malformed parameters.
+		 */
+		int load(const std::string& filename);
+
+		/** Pre-renders the fixed (positional and rectangle) layers for frames
+		 * of the given size. Returns false if a positional rule is outside of
+		 * the frame.
+		 *
+		 * With a pyramid_level above 0, also prepares coarse(): the same
+		 * program for frames reduced that many times by pyrDown, with
+		 * coordinates and openings scaled down.
+		 */
+		bool rasterize(const cv::Size& frame_size, int pyramid_level = 0);
+
+		/** Program for the pyramid level given to rasterize(), or nullptr */
+		const FilterProgram* coarse() const { return coarse_program.get(); }
+		int pyramidLevel() const { return pyramid_level; }
+
+		/** Size of a frame after level pyrDown calls */
+		static cv::Size pyramidSize(cv::Size frame_size, int level);
+
+		/** Builds the CV_32SC1 watershed markers for src. rasterize() must
+		 * have been called with the size of src.
+		 */
+		void execute(const cv::Mat& src, cv::Mat& mask) const;
+
+		/** Same as execute(), only for the region roi of src. The markers
+		 * have the size of roi.
+		 */
+		void execute(const cv::Mat& src, const cv::Rect& roi, cv::Mat& mask) const;
+
+		/** Same as execute(), with the temporaries in scratch. mask and the
+		 * scratch buffers are only allocated if they do not have the size of
+		 * roi already.
+		 */
+		void execute(const cv::Mat& src, const cv::Rect& roi, cv::Mat& mask, Scratch& scratch) const;
+
+		/** Allocates the buffers of scratch for frames of the rasterized size,
+		 * so that execute() on them or on any region of them allocates
+		 * nothing more
+		 */
+		void reserve(Scratch& scratch) const;
+
+		/** Same as execute(), through the cvtColor/inRange path. Kept as a
+		 * reference for the lookup table kernel.
+		 */
+		void executeReference(const cv::Mat& src, cv::Mat& mask) const;
+		void executeReference(const cv::Mat& src, const cv::Rect& roi, cv::Mat& mask) const;
+
+	private:
+		/** One execution step: either a fixed layer or a HSV rule */
+		struct Step {
+			bool fixed;
+			size_t index; // Into layers if fixed, into hsvs otherwise
+		};
+
+		/** Consecutive fixed rules, rendered once */
+		struct Layer {
+			cv::Mat values;
+			cv::Mat coverage;
+			cv::Mat objects;
+		};
+
+		std::vector<Step> steps;
+		std::vector<Layer> layers;
+		cv::Size size;
+		int pyramid_level = 0;
+		std::shared_ptr<const FilterProgram> coarse_program;
+
+		// BGR -> matching rules lookup tables. Only the smallest one that fits
+		// all HSV rules is built. Copies of the program share them.
+		struct Luts {
+			std::vector<uint8_t> lut8;
+			std::vector<uint16_t> lut16;
+			std::vector<uint32_t> lut32;
+		};
+		std::shared_ptr<const Luts> luts;
+		unsigned char fg_table[256]; // Mask value after a matching 'f' HSV rule
+		unsigned char bg_table[256]; // Mask value after a matching 'b' HSV rule
+
+		void buildLut();
+		template <typename T> void executeLut(const cv::Mat& src, const cv::Rect& roi, const std::vector<T>& lut, cv::Mat& mask, Scratch& scratch) const;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef FRAME_INDEX_HPP
+#define FRAME_INDEX_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+/** Index sidecar of a polygon output, WKT or polygon stream, with one entry
+ * per processed frame, including those without any contour.
+ *
+ * All values are little endian. The file starts with a header:
+ *   char[4]  magic "MPIX"
+ *   uint32   version (FRAME_INDEX_VERSION)
+ *   uint32   header size in bytes, entries start right after it
+ *   uint32   entry size in bytes
+ * followed by one entry per frame, in frame order:
+ *   uint64   frame index
+ *   float64  timestamp in ms, NaN if unknown
+ *   uint64   offset in the polygon file of the first byte of the frame
+ *   uint64   offset decoding must start at, the frame itself unless it is
+ *            an edit of a keyframe (see polygon_stream.hpp)
+ *   uint32   length in bytes of the frame in the polygon file
+ *   uint32   number of polygons, 0 marks a frame without contours
+ */
+const uint32_t FRAME_INDEX_VERSION = 1;
+
+/** One entry of a frame index */
+struct FrameEntry {
+	uint64_t frame = 0;
+	double timestamp = 0;
+	uint64_t offset = 0;
+	uint64_t keyframe = 0;
+	uint32_t length = 0;
+	uint32_t polygons = 0;
+
+	bool empty() const { return polygons == 0; }
+};
+
+/** Sidecar name of a polygon file */
+std::string frameIndexName(const std::string& poly_file);
+
+/** Writes a frame index through a memory buffer */
+class FrameIndexWriter {
+	public:
+		static const size_t FLUSH_SIZE = 1 << 16;
+
+		~FrameIndexWriter();
+
+		/** Creates filename, replacing any existing file, and writes the header */
+		bool open(const std::string& filename);
+		bool isOpen() const { return out.is_open(); }
+
+		void add(const FrameEntry& entry);
+
+		/** Adds the entries of the index in filename, for a polygon file
+		 * appended at offset base
+		 */
+		bool append(const std::string& filename, uint64_t base);
+
+		/** Writes buffered entries to the file. Returns false on write errors. */
+		bool flush();
+		void close();
+
+	private:
+		std::ofstream out;
+		std::vector<unsigned char> buffer;
+};
+
+/** Frame index mapped in memory. Lookups by frame are O(1) for the usual
+ * index of consecutive frames, and binary searches otherwise.
+ */
+class FrameIndex {
+	public:
+		/** Maps filename and checks its header. Errors are written to std::cerr. */
+		bool open(const std::string& filename);
+		void close();
+
+		size_t size() const { return count; }
+		FrameEntry entry(size_t i) const;
+
+		/** Entry of frame. Returns false if the frame was not processed. */
+		bool find(uint64_t frame, FrameEntry& entry) const;
+
+		/** Entry of the last frame at or before timestamp, in ms. Returns false
+		 * if there is none.
+		 */
+		bool findTime(double timestamp, FrameEntry& entry) const;
+
+	private:
+		MappedFile file;
+		const unsigned char* entries = nullptr;
+		size_t entry_size = 0;
+		size_t count = 0;
+};
+
+#endif
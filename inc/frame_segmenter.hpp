@@ -0,0 +1,98 @@
+#ifndef FRAME_SEGMENTER_HPP
+#define FRAME_SEGMENTER_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "filter_program.hpp"
+
+/** Options for the segmentation of a single frame */
+struct SegmentOptions {
+	int blur = 0; // Blur size before watershed, 0 to disable
+	int approx = cv::CHAIN_APPROX_SIMPLE; // Contour approximation passed to findContours
+	bool overlay = false; // Generates the overlay image
+	int track_margin = -1; // Margin around the previous contour for tracking, negative disables it
+	int band = 4; // Half width, in pixels, of the band refined at full resolution in pyramid mode
+};
+
+/** Result of the segmentation of a single frame */
+struct Segmentation {
+	std::vector<std::vector<cv::Point>> contours;
+	size_t biggest = 0; // Index of the largest contour
+	cv::Mat segmented; // Overlay, if requested
+	cv::Rect roi; // Region that was segmented
+
+	/** Largest contour of each object, indexed by object ID - 1 (empty if the
+	 * object was not found). Only used by filters with more than one object,
+	 * in which case contours holds these same contours.
+	 */
+	std::vector<std::vector<cv::Point>> objects;
+
+	bool found() const { return !contours.empty(); }
+	const std::vector<cv::Point>& largest() const { return contours[biggest]; }
+};
+
+/** Temporaries of the segmentation of a frame, reused from frame to frame.
+ * Buffers grow to the largest region they have been used for and are then
+ * taken as views, so once the first frames are done, segmenting allocates no
+ * image buffers. Every thread that segments frames needs its own.
+ */
+struct FrameBuffers {
+	cv::Mat markers; // Watershed markers of the region (CV_32SC1)
+	cv::Mat proc; // Blurred region
+	FilterProgram::Scratch filter;
+	std::vector<signed char> trace; // Work buffer of traceLabelContours
+	std::vector<std::vector<cv::Point>> contours; // Contours of one object
+	std::vector<cv::Rect> boxes; // Box of every object label, or of every piece of the band
+	std::vector<cv::Point> box_tl, box_br;
+
+	//Pyramid mode
+	std::vector<cv::Mat> levels; // Frame reduced once, twice, ...
+	cv::Mat coarse_proc, coarse_markers;
+	cv::Mat labels, low, high, band, no_label;
+	cv::Mat band_labels; // Connected pieces of the band
+	std::vector<cv::Rect> refined; // Regions of the last frame refined at full resolution
+	cv::Mat kernel;
+	cv::Mat seeds, unknown;
+	cv::Mat ring[4]; // Outer pixels of the refined region
+
+	/** Allocates the buffers for frames of frame_size and frame_type, and
+	 * for every region of them, unless they already fit
+	 */
+	void reserve(const FilterProgram& filter, cv::Size frame_size, int frame_type, const SegmentOptions& opts);
+};
+
+/** Object position carried between consecutive frames in tracking mode */
+struct TrackState {
+	bool valid = false;
+	cv::Rect box; // Bounding box of the last contour found
+};
+
+/** Returns the index of the contour with more points */
+size_t largestContour(const std::vector<std::vector<cv::Point>>& contours);
+
+/** Builds the mask of frame, runs watershed and extracts the largest contour.
+ * Only reads filter and frame, so it can be called from several threads,
+ * each with its own buffers.
+ *
+ * If the filter was rasterized with a pyramid level, mask and watershed are
+ * first computed on the reduced frame. Only a band of opts.band pixels around
+ * the coarse boundaries is then flooded again at full resolution, with the
+ * rest of the coarse labels as markers.
+ */
+void segmentFrame(const FilterProgram& filter, const cv::Mat& frame, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out);
+
+/** Same as segmentFrame(), but only inside roi. Contours are in frame coordinates. */
+void segmentRegion(const FilterProgram& filter, const cv::Mat& frame, const cv::Rect& roi, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out);
+
+/** Segments frame only around the contour of the previous frame, grown by
+ * opts.track_margin. Falls back to the full frame (through the pyramid, if
+ * any) when there is no previous contour, when nothing is found or when the
+ * contour touches the border of the region. Frames depend on each other, so
+ * it must be called in order.
+ */
+void segmentTracked(const FilterProgram& filter, const cv::Mat& frame, const SegmentOptions& opts, TrackState& state, FrameBuffers& buffers, Segmentation& out);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LABEL_CONTOURS_HPP
+#define LABEL_CONTOURS_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Traces the external contours of the pixels of a CV_32SC1 label image
+ * (e.g. watershed markers) whose label is within [lower, upper].
+ *
+ * The labels are read once into a padded work buffer, which replaces the
+ * convertTo/threshold/convertTo chain and the copy findContours makes
+ * internally. Tracing follows OpenCV's own border following for
+ * RETR_EXTERNAL, so contours and their points come out in the same order
+ * findContours would give them. approx is CHAIN_APPROX_NONE or
+ * CHAIN_APPROX_SIMPLE; offset is added to every point.
+ */
+void traceLabelContours(const cv::Mat& labels, int lower, int upper,
+		std::vector<std::vector<cv::Point>>& contours, int approx,
+		cv::Point offset = cv::Point());
+
+/** Same as traceLabelContours(), with the work buffer kept by the caller.
+ * The point vectors already in contours are reused for the new contours.
+ */
+void traceLabelContours(const cv::Mat& labels, int lower, int upper,
+		std::vector<std::vector<cv::Point>>& contours, int approx,
+		cv::Point offset, std::vector<signed char>& buffer);
+
+/** Bounding box of every label in [0, max_label] of a CV_32SC1 label image,
+ * found in a single pass with a dense table. Labels that do not appear, or
+ * that are outside the range, get an empty Rect.
+ */
+void labelBoxes(const cv::Mat& labels, int max_label, std::vector<cv::Rect>& boxes);
+
+/** Same as labelBoxes(), with the corner tables kept by the caller */
+void labelBoxes(const cv::Mat& labels, int max_label, std::vector<cv::Rect>& boxes,
+		std::vector<cv::Point>& tl, std::vector<cv::Point>& br);
+
+#endif
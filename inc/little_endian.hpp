@@ -0,0 +1,43 @@
+#ifndef LITTLE_ENDIAN_HPP
+#define LITTLE_ENDIAN_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/** Fixed size little endian values of the binary output files */
+
+inline void putU32(std::vector<unsigned char>& buf, uint32_t v) {
+	for (int i = 0; i < 4; ++i) {
+		buf.push_back((v >> (8 * i)) & 0xff);
+	}
+}
+
+inline void putU64(std::vector<unsigned char>& buf, uint64_t v) {
+	for (int i = 0; i < 8; ++i) {
+		buf.push_back((v >> (8 * i)) & 0xff);
+	}
+}
+
+inline void putF64(std::vector<unsigned char>& buf, double v) {
+	uint64_t bits;
+	std::memcpy(&bits, &v, sizeof(bits));
+	putU64(buf, bits);
+}
+
+inline uint32_t getU32(const unsigned char* p) {
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline uint64_t getU64(const unsigned char* p) {
+	return uint64_t(getU32(p)) | (uint64_t(getU32(p + 4)) << 32);
+}
+
+inline double getF64(const unsigned char* p) {
+	uint64_t bits = getU64(p);
+	double v;
+	std::memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+#endif
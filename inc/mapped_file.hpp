@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+/** A file mapped read only in memory. Pages are read by the kernel as they
+ * are touched, so files larger than memory can be walked through.
+ */
+class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/** Maps filename, hinting the kernel it will be read in order. Errors
+		 * are written to std::cerr. An empty file is open with size 0.
+		 */
+		bool open(const std::string& filename);
+		void close();
+
+		bool isOpen() const { return is_open; }
+		const char* data() const { return map; }
+		size_t size() const { return length; }
+
+	private:
+		const char* map = nullptr;
+		size_t length = 0;
+		bool is_open = false;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MEMORY_ACCOUNTING_HPP
+#define MEMORY_ACCOUNTING_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/** Opt-in accounting of the memory a tool allocates, in two kinds: Mat data,
+ * counted by a MatAllocator installed as the OpenCV default, and everything
+ * allocated with new, such as contour vectors, counted by replacements of the
+ * global operator new and delete.
+ *
+ * While disabled, each allocation costs one relaxed atomic load. Enabled,
+ * allocations also update the totals of their kind and the bytes and count
+ * of the allocating thread, which StageTimer (see metrics.hpp) reads to
+ * attribute allocations to stages.
+ */
+
+extern std::atomic<bool> memory_accounting_enabled;
+
+inline bool memoryAccountingEnabled() {
+	return memory_accounting_enabled.load(std::memory_order_relaxed);
+}
+
+/** Installs the Mat allocator and starts counting. Mats keep the allocator
+ * that created them, so call it before the Mats to count are created.
+ */
+void enableMemoryAccounting();
+
+/** Allocations of one kind since accounting was enabled, in bytes */
+struct AllocationStats {
+	uint64_t count;
+	uint64_t bytes;
+	int64_t resident; // Allocated and not freed yet
+	int64_t peak; // Highest resident
+};
+
+AllocationStats matAllocations();
+
+/** Heap blocks are counted by their usable size. A block allocated before
+ * accounting was enabled still counts when freed, so resident bytes are
+ * approximate by the little allocated before main.
+ */
+AllocationStats heapAllocations();
+
+/** Bytes and number of allocations of both kinds made by this thread */
+uint64_t threadAllocatedBytes();
+uint64_t threadAllocationCount();
+
+/** Bytes and number of Mat allocations made by this thread */
+uint64_t threadMatAllocatedBytes();
+uint64_t threadMatAllocationCount();
+
+/** Highest resident Mat bytes since the previous call, after which the next
+ * window starts from the bytes resident now
+ */
+int64_t takeMatPeak();
+
+#endif
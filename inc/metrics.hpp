@@ -0,0 +1,152 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "memory_accounting.hpp"
+#include "trace.hpp"
+
+/** Latency of one stage of a tool, such as decoding or watershed.
+ *
+ * Durations go to a histogram of 8 buckets per power of two, so percentiles
+ * are within 1/8 of the true value, and every update is a few relaxed atomic
+ * additions that any thread can make without locking.
+ */
+class StageMetrics {
+	public:
+		static const int BUCKETS = 512;
+
+		explicit StageMetrics(const std::string& name);
+
+		void add(int64_t ns);
+
+		/** Allocations made during the stage, with memory accounting enabled */
+		void addAllocations(uint64_t bytes, uint64_t n);
+
+		const std::string& name() const { return stage_name; }
+		uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+		int64_t totalNs() const { return total.load(std::memory_order_relaxed); }
+		int64_t maxNs() const { return max.load(std::memory_order_relaxed); }
+		uint64_t allocatedBytes() const { return alloc_bytes.load(std::memory_order_relaxed); }
+		uint64_t allocationCount() const { return alloc_count.load(std::memory_order_relaxed); }
+
+		/** Duration below which a fraction q of the samples are, in ns */
+		double percentileNs(double q) const;
+
+	private:
+		std::string stage_name;
+		std::atomic<uint64_t> samples;
+		std::atomic<int64_t> total;
+		std::atomic<int64_t> max;
+		std::atomic<uint64_t> alloc_bytes;
+		std::atomic<uint64_t> alloc_count;
+		std::atomic<uint64_t> buckets[BUCKETS];
+};
+
+/** Adds the time from construction to destruction to a stage, and to the
+ * trace if enabled. With memory accounting enabled, also adds what this
+ * thread allocated in the meantime.
+ */
+class StageTimer {
+	public:
+		explicit StageTimer(StageMetrics& stage) : stage(stage), start(std::chrono::steady_clock::now()) {
+			if (memoryAccountingEnabled()) {
+				start_bytes = threadAllocatedBytes();
+				start_count = threadAllocationCount();
+			}
+		}
+		~StageTimer() {
+			const auto end = std::chrono::steady_clock::now();
+			stage.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+			if (tracingEnabled()) {
+				traceEvent(stage.name().c_str(), start, end);
+			}
+			if (memoryAccountingEnabled()) {
+				stage.addAllocations(threadAllocatedBytes() - start_bytes, threadAllocationCount() - start_count);
+			}
+		}
+
+		StageTimer(const StageTimer&) = delete;
+		StageTimer& operator=(const StageTimer&) = delete;
+
+	private:
+		StageMetrics& stage;
+		std::chrono::steady_clock::time_point start;
+		uint64_t start_bytes = 0;
+		uint64_t start_count = 0;
+};
+
+/** Sampled level of something, such as the depth of a queue */
+class GaugeMetrics {
+	public:
+		explicit GaugeMetrics(const std::string& name);
+
+		void sample(int64_t value);
+
+		const std::string& name() const { return gauge_name; }
+		uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+		double mean() const;
+		int64_t maxValue() const { return max.load(std::memory_order_relaxed); }
+
+	private:
+		std::string gauge_name;
+		std::atomic<uint64_t> samples;
+		std::atomic<int64_t> sum;
+		std::atomic<int64_t> max;
+};
+
+/** Stages, gauges and frame count of a run, reported to the console at most
+ * once per interval and written as JSON at the end.
+ *
+ * Stages and gauges are created on first use and never removed, so sites can
+ * keep a reference to them, typically in a function level static:
+ *   static StageMetrics& stage = metrics().stage("watershed");
+ *   StageTimer timer(stage);
+ */
+class Metrics {
+	public:
+		Metrics();
+
+		StageMetrics& stage(const std::string& name);
+		GaugeMetrics& gauge(const std::string& name);
+
+		/** Frames done, for the frame rate */
+		void addFrames(uint64_t n = 1) { frames += n; }
+
+		/** Frames expected in the run, for the progress. 0 if unknown. */
+		void setExpectedFrames(uint64_t n) { expected = n; }
+
+		/** Seconds between two reports, 0 to report on every call */
+		void setInterval(double seconds) { interval = seconds; }
+
+		/** Prints the progress and the mean time of every stage so far, unless
+		 * the last report was less than the interval ago or force is set.
+		 * Forced reports also print the memory use, if accounted.
+		 */
+		void report(std::ostream& out, bool force = false);
+
+		/** Writes every metric as JSON, with tool as the name of the run */
+		bool writeJson(const std::string& filename, const std::string& tool) const;
+
+	private:
+		mutable std::mutex m; // Guards the lists, not the metrics in them
+		std::vector<std::unique_ptr<StageMetrics>> stages;
+		std::vector<std::unique_ptr<GaugeMetrics>> gauges;
+		std::atomic<uint64_t> frames;
+		std::atomic<uint64_t> expected;
+		double interval = 5;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::time_point last_report;
+};
+
+/** Metrics of this process */
+Metrics& metrics();
+
+#endif
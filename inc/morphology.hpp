@@ -0,0 +1,44 @@
+#ifndef MORPHOLOGY_HPP
+#define MORPHOLOGY_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Below this many iterations erodeRect()/dilateRect() call OpenCV directly,
+ * whose vectorized filters win on small kernels.
+ */
+const int RUNNING_MORPHOLOGY_MIN_ITERATIONS = 4;
+
+/** Temporaries of erodeRect()/dilateRect(), kept by callers that run them on
+ * every frame so they are allocated once
+ */
+struct MorphologyBuffers {
+	cv::Mat kernels[RUNNING_MORPHOLOGY_MIN_ITERATIONS]; // Square kernels of the OpenCV path, by iterations
+	cv::Mat rows; // Result of the row pass
+	cv::Mat g, h; // Column pass
+	std::vector<unsigned char> row_p, row_g, row_h; // Row pass
+	std::vector<unsigned char> neutral;
+};
+
+/** Same result as erode(src, dst, Mat(), Point(-1, -1), iterations) on a
+ * CV_8UC1 image: the minimum over a (2 * iterations + 1) square window, with
+ * pixels outside of the image ignored.
+ *
+ * Large windows use the van Herk/Gil-Werman running minimum, separately over
+ * rows and columns, so the cost per pixel does not depend on iterations.
+ */
+void erodeRect(const cv::Mat& src, cv::Mat& dst, int iterations);
+void erodeRect(const cv::Mat& src, cv::Mat& dst, int iterations, MorphologyBuffers& buffers);
+
+/** Same as erodeRect(), for dilate() and the running maximum */
+void dilateRect(const cv::Mat& src, cv::Mat& dst, int iterations);
+void dilateRect(const cv::Mat& src, cv::Mat& dst, int iterations, MorphologyBuffers& buffers);
+
+/** Opening made of erodeRect() and dilateRect() with the same iterations, as
+ * the HSV filters apply it.
+ */
+void openRect(const cv::Mat& src, cv::Mat& dst, int iterations);
+void openRect(const cv::Mat& src, cv::Mat& dst, int iterations, MorphologyBuffers& buffers);
+
+#endif
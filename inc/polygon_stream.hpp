@@ -0,0 +1,179 @@
+#ifndef POLYGON_STREAM_HPP
+#define POLYGON_STREAM_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "mapped_file.hpp"
+
+/** Binary polygon stream, a compact alternative to one WKT polygon per line.
+ *
+ * All values are little endian. The file starts with a header:
+ *   char[4]  magic "MPLY"
+ *   uint32   version (POLYGON_STREAM_VERSION)
+ *   uint32   header size in bytes, records start right after it
+ *   uint32   flags, POLYGON_STREAM_TEMPORAL if records may be edits
+ * followed by records, only ever appended:
+ *   uint32   size of the rest of the record, in bytes
+ *   uint64   frame index
+ *   float64  timestamp in ms, NaN if unknown
+ *   uint32   object ID
+ *   uint32   vertex count
+ *   uint8    vertex encoding,
+ *            ORed with POLYGON_KEYFRAME on the records of keyframes
+ *   vertices, by encoding:
+ *     POLYGON_DELTAS: zigzag varints, x then y, each one the difference to
+ *       the previous vertex (the first one to (0, 0))
+ *     POLYGON_CHAIN_CODE: the first vertex as two zigzag varints, then the
+ *       Freeman codes of the steps to the others, 3 bits each (see chain_code.hpp)
+ *     POLYGON_EDIT: an edit script over the vertices of the previous record
+ *       of the same object, as varints of (length << 2 | operation) until the
+ *       end of the record. Operations copy or skip length vertices of the
+ *       previous polygon, or insert the length vertices that follow, as
+ *       zigzag varint differences to the last vertex output.
+ *
+ * Neighbour vertices of full contours differ by at most one pixel, so most
+ * deltas take two bytes and chain codes take 3 bits. The record size lets
+ * readers skip records without decoding them, and a record cut short by a
+ * writer that stopped is ignored.
+ *
+ * Edits only refer to records since the last keyframe, whose records are all
+ * full polygons, so decoding can start at any keyframe. Streams without the
+ * temporal flag have no edits, and every record can be decoded on its own.
+ */
+const uint32_t POLYGON_STREAM_VERSION = 1;
+const size_t POLYGON_STREAM_HEADER_SIZE = 16; // As written, readers follow the header
+
+enum PolygonEncoding : uint8_t {
+	POLYGON_DELTAS = 0,
+	POLYGON_CHAIN_CODE = 1,
+	POLYGON_EDIT = 2,
+	POLYGON_KEYFRAME = 0x80 // Flag, record belongs to a keyframe
+};
+
+const uint32_t POLYGON_STREAM_TEMPORAL = 1;
+
+/** One record of a polygon stream */
+struct PolygonRecord {
+	uint64_t frame = 0;
+	double timestamp = 0;
+	uint32_t object = 1;
+	std::vector<cv::Point> points;
+};
+
+/** Appends records to a polygon stream through a memory buffer, written to the
+ * file in large blocks and always at record boundaries.
+ *
+ * With chain codes enabled, contours that step between neighbour pixels are
+ * written as chain codes and any other polygon as deltas.
+ *
+ * With a keyframe interval, frames are written as edits of the previous
+ * record of each object, whenever that is smaller, and every interval frames
+ * one is written whole as a keyframe.
+ */
+class PolygonStreamWriter {
+	public:
+		static const size_t FLUSH_SIZE = 1 << 20;
+
+		~PolygonStreamWriter();
+
+		/** Creates filename, replacing any existing file, and writes the header.
+		 * A keyframe interval of 0 or 1 writes every polygon whole.
+		 */
+		bool open(const std::string& filename, bool chain_code = false, int keyframe_interval = 0);
+		bool isOpen() const { return out.is_open(); }
+
+		void write(uint64_t frame, double timestamp, uint32_t object, const std::vector<cv::Point>& points);
+
+		/** Offset the next record will be written at */
+		uint64_t tell() const { return written + buffer.size(); }
+
+		/** Offset of the first record of the frame decoding of the last frame
+		 * written must start at: its keyframe, or the frame itself without
+		 * keyframes
+		 */
+		uint64_t keyframeOffset() const { return key_offset; }
+
+		/** Appends every complete record of the stream in filename, which must
+		 * not be temporal unless this one is. It starts a new keyframe interval.
+		 */
+		bool append(const std::string& filename);
+
+		/** Writes buffered records to the file. Returns false on write errors. */
+		bool flush();
+		void close();
+
+	private:
+		std::ofstream out;
+		std::vector<unsigned char> buffer;
+		std::vector<unsigned char> edit; // Scratch for edit scripts
+		bool chain_code = false;
+		int keyframe_interval = 0;
+
+		//Frames since the last keyframe and polygons since then by object
+		uint64_t last_frame = 0;
+		int frames = 0;
+		bool keyframe = false;
+		bool restart = true; // Next write starts a keyframe
+		uint64_t key_offset = 0;
+		uint64_t written = 0; // Bytes already in the file
+		std::map<uint32_t, std::vector<cv::Point>> references;
+};
+
+/** Reads a polygon stream mapped in memory. Records are decoded one at a time,
+ * so files of any length can be iterated.
+ */
+class PolygonStreamReader {
+	public:
+		~PolygonStreamReader();
+
+		/** Maps filename and checks its header. Errors are written to std::cerr. */
+		bool open(const std::string& filename);
+		void close();
+
+		/** Decodes the next record. Returns false at the end of the stream, at
+		 * an incomplete record or at an edit whose reference was not read,
+		 * after a seek() to anything but a keyframe.
+		 */
+		bool next(PolygonRecord& record);
+
+		/** Offset of the next record, which can be given to seek() later */
+		size_t tell() const { return pos; }
+		bool seek(size_t offset);
+
+		/** Moves to the first record of the first frame at or after frame,
+		 * decoding from the keyframe before it. Returns false if there is none.
+		 */
+		bool seekFrame(uint64_t frame);
+
+		/** Header size and mapped bytes, records are in between */
+		size_t begin() const { return header_size; }
+		size_t end() const { return size; }
+		const unsigned char* data() const { return map; }
+		bool temporal() const { return flags & POLYGON_STREAM_TEMPORAL; }
+
+		/** True if filename starts with the polygon stream magic */
+		static bool isStream(const std::string& filename);
+
+	private:
+		MappedFile file;
+		const unsigned char* map = nullptr;
+		size_t size = 0;
+		size_t header_size = 0;
+		size_t pos = 0;
+		uint32_t flags = 0;
+		std::map<uint32_t, std::vector<cv::Point>> references; // Last polygon of each object, for edits
+		size_t previous = 0; // Offset of the record last decoded, 0 after a seek
+
+		/** Frame of the record at offset and whether decoding can start there */
+		uint64_t frameAt(size_t offset) const;
+		bool isKeyframe(size_t offset) const;
+		bool isComplete(size_t offset) const;
+};
+
+#endif
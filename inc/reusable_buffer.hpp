@@ -0,0 +1,24 @@
+#ifndef REUSABLE_BUFFER_HPP
+#define REUSABLE_BUFFER_HPP
+
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+/** Returns a size x type view of the top left corner of storage, which is
+ * only reallocated when it is smaller than size or of another type.
+ *
+ * Buffers of a region that changes from frame to frame, such as a tracking
+ * window, are then allocated once at their largest size instead of on every
+ * frame. The view has the requested size and type, so create() on it, as
+ * OpenCV functions do on their outputs, keeps it in place.
+ */
+inline cv::Mat reuseBuffer(cv::Mat& storage, cv::Size size, int type) {
+	if (storage.type() != type || storage.cols < size.width || storage.rows < size.height) {
+		const bool same_type = storage.type() == type;
+		storage.create(std::max(same_type ? storage.rows : 0, size.height), std::max(same_type ? storage.cols : 0, size.width), type);
+	}
+	return storage(cv::Rect(cv::Point(0, 0), size));
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/** Opt-in event trace in the Chrome trace event format, for chrome://tracing
+ * or https://ui.perfetto.dev.
+ *
+ * Every StageTimer (see metrics.hpp) and TraceFrame becomes a complete event
+ * with its thread and, if known, the frame it worked on. Each thread appends
+ * to a buffer of its own, so recording takes no lock. While tracing is
+ * disabled, the only cost is one relaxed atomic load per timer.
+ */
+
+extern std::atomic<bool> tracing_enabled;
+
+inline bool tracingEnabled() {
+	return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+void enableTracing(bool enabled = true);
+
+/** Records an event named name (which must outlive the trace) on this thread */
+void traceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+/** Name of this thread in the trace */
+void setTraceThreadName(const std::string& name);
+
+/** Marks the events of this thread, until destruction, as working on frame,
+ * and records the whole scope as a "frame" event
+ */
+class TraceFrame {
+	public:
+		explicit TraceFrame(int64_t frame);
+		~TraceFrame();
+
+		TraceFrame(const TraceFrame&) = delete;
+		TraceFrame& operator=(const TraceFrame&) = delete;
+
+	private:
+		int64_t previous;
+		std::chrono::steady_clock::time_point start;
+};
+
+/** Writes every event recorded so far as Chrome trace JSON. Call once the
+ * traced threads are done.
+ */
+bool writeTrace(const std::string& filename);
+
+#endif
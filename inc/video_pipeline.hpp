@@ -0,0 +1,53 @@
+#ifndef VIDEO_PIPELINE_HPP
+#define VIDEO_PIPELINE_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "frame_segmenter.hpp"
+
+/** A decoded frame and its segmentation, as it moves through the pipeline */
+struct PipelineItem {
+	size_t index = 0;
+	double timestamp = 0; // Position of the frame in the video, in ms
+	cv::Mat frame;
+	Segmentation result;
+};
+
+/** Runs read -> process -> write with one decoder thread, a pool of workers
+ * processing independent frames and an ordered writer on the calling thread.
+ *
+ * read() fills the frame and timestamp of an item. It is only called from
+ * the decoder thread, and write() only from the calling thread, always in
+ * frame order. process() also gets the index, below workers, of the worker
+ * calling it, for buffers of its own. At most max_in_flight frames are
+ * decoded and not yet written, so memory does not depend on video length.
+ *
+ * Written items go back to the decoder, which reads the next frames into
+ * them, so their frames and results keep their memory from frame to frame.
+ */
+void runPipeline(const std::function<bool(PipelineItem&)>& read,
+		const std::function<void(PipelineItem&, size_t)>& process,
+		const std::function<void(PipelineItem&)>& write,
+		size_t workers, size_t max_in_flight);
+
+/** Half-open range of frames [begin, end) of a video */
+struct FrameRange {
+	size_t begin;
+	size_t end; // SIZE_MAX reads until the end of the video
+};
+
+/** Splits a video in up to n ranges, each starting at a position the capture
+ * reports it can seek to, so every range can be decoded by its own
+ * VideoCapture. Ranges that would be empty are merged with the previous one.
+ */
+std::vector<FrameRange> splitVideo(const std::string& filename, size_t n);
+
+/** Returns filename with ".part<k>" before its extension */
+std::string partName(const std::string& filename, size_t k);
+
+#endif
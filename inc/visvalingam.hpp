@@ -0,0 +1,26 @@
+#ifndef VISVALINGAM_HPP
+#define VISVALINGAM_HPP
+
+#include <cstddef>
+
+#include "polygon.hpp"
+
+/** Removes the given fraction (0 to 1) of the points of polygon with
+ * Visvalingam-Whyatt: the point whose triangle with its neighbours has the
+ * smallest area goes first, and the areas of its neighbours are computed
+ * again. The first and last points are kept, and so are at least 3 points.
+ *
+ * Vertices are kept in a linked list and their areas in an indexed min-heap,
+ * so only the two neighbours of each removed point are updated, in
+ * O(log n), and the whole reduction is O(n log n). Ties of area go to the
+ * earliest point, so points are removed in the same order as by searching
+ * the smallest area from the start on every step.
+ */
+void visvalingamReduce(Polygon& polygon, double reduction);
+
+/** Same reduction by searching the smallest area on every step, in O(n^2),
+ * as reference for visvalingamReduce()
+ */
+void visvalingamReduceNaive(Polygon& polygon, double reduction);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef WKT_READER_HPP
+#define WKT_READER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "mapped_file.hpp"
+
+/** One polygon line of a WKT file */
+struct WktPolygon {
+	bool keyed = false; // Line was "<frame> <object> <WKT>", as auto_segmenter writes for several objects
+	uint64_t frame = 0;
+	uint32_t object = 1;
+	uint64_t line = 0; // Line number, from 0, counted since open() or the last seek()
+	std::vector<cv::Point2d> points; // Ring as written, closing vertex included
+};
+
+/** Reads files with one "POLYGON ((x y, ...))" per line, straight from the
+ * file mapped in memory.
+ *
+ * Numbers are parsed in place, with no stream, string or locale in between.
+ * Polygons are read one at a time into a reused WktPolygon, so a sequence of
+ * any length can be iterated, and index() gives the offset of every line
+ * for random access through seek().
+ */
+class WktReader {
+	public:
+		bool open(const std::string& filename);
+		void close() { file.close(); pos = 0; line = 0; }
+
+		/** Parses the next non-empty line. Returns false at the end of the
+		 * file or on a malformed line, which is reported with its offset.
+		 */
+		bool next(WktPolygon& polygon);
+
+		/** Offsets of every non-empty line, found without parsing them */
+		std::vector<size_t> index() const;
+
+		size_t tell() const { return pos; }
+		bool seek(size_t offset);
+		size_t size() const { return file.size(); }
+		bool atEnd() const { return pos >= file.size(); }
+
+	private:
+		MappedFile file;
+		size_t pos = 0;
+		uint64_t line = 0;
+};
+
+/** Reads the whitespace separated "x y" pairs of a points file (.pof) until
+ * the end of the file or the first token that is not a number.
+ */
+bool readPointFile(const std::string& filename, std::vector<cv::Point2d>& points);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef WKT_WRITER_HPP
+#define WKT_WRITER_HPP
+
+#include <ostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Punctuation of a WKT polygon, which differs between tools */
+struct WktStyle {
+	const char* prefix;
+	const char* separator; // Between vertices
+	bool close_ring; // Repeats the first vertex at the end
+};
+
+const WktStyle WKT_SPACED = {"POLYGON ((", ", ", true}; // segmenter and auto_segmenter
+const WktStyle WKT_COMPACT = {"POLYGON((", ",", true}; // cell_extraction
+const WktStyle WKT_OPEN = {"POLYGON ((", ",", false}; // warp
+
+/** Formats WKT polygons into a fixed buffer, written to the stream in blocks.
+ *
+ * Integers are formatted by hand and doubles with the fewest digits that
+ * read back to the same value, so nothing is allocated per coordinate and
+ * no stream locale is involved. Buffered text reaches the stream on flush(),
+ * when the block is full or on destruction.
+ */
+class WktWriter {
+	public:
+		static const size_t BLOCK_SIZE = 1 << 16;
+
+		explicit WktWriter(std::ostream& out, const WktStyle& style = WKT_SPACED);
+		~WktWriter();
+
+		WktWriter(const WktWriter&) = delete;
+		WktWriter& operator=(const WktWriter&) = delete;
+
+		/** Writes one polygon, without a line break */
+		void polygon(const std::vector<cv::Point>& points);
+		void polygon(const std::vector<cv::Point2d>& points);
+
+		WktWriter& text(const char* s);
+		WktWriter& number(int v) { return number(static_cast<long long>(v)); }
+		WktWriter& number(long long v);
+		WktWriter& number(double v);
+
+		/** Bytes written through this writer, buffered or not */
+		size_t tell() const { return written + used; }
+
+		void flush();
+
+	private:
+		std::ostream& out;
+		WktStyle style;
+		char buffer[BLOCK_SIZE];
+		size_t used = 0;
+		size_t written = 0;
+
+		/** Makes room for n more chars */
+		void reserve(size_t n) {
+			if (used + n > BLOCK_SIZE) flush();
+		}
+		template <typename P> void vertices(const std::vector<P>& points);
+};
+
+#endif
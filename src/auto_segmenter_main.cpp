@@ -1,18 +1,30 @@
 #include <chrono>
+#include <climits>
+#include <cstdio>
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
-#include <sstream>
 
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "batch_segmenter.hpp"
 #include "cxxopts.hpp"
-#include "polygon.hpp"
+#include "filter_program.hpp"
+#include "frame_index.hpp"
+#include "frame_segmenter.hpp"
+#include "label_contours.hpp"
+#include "memory_accounting.hpp"
+#include "metrics.hpp"
+#include "polygon_stream.hpp"
+#include "trace.hpp"
+#include "video_pipeline.hpp"
+#include "wkt_writer.hpp"
 
 using namespace cv;
 using std::string;
@@ -24,88 +36,130 @@ int mode = 0;
 int cur_obj = 0;
 const char* WHNDL = "IntermediateProc";
 
-/** Returns a mask after converting src image to HSV space, and auto-finding
- * parameters
+/** Reads the next frame, timed as the decode stage */
+bool readFrame(VideoCapture& vid, Mat& frame) {
+	static StageMetrics& stage = metrics().stage("decode");
+	StageTimer timer(stage);
+	return vid.read(frame);
+}
+
+/** Copies the whole of file to the end of out, which may be nothing for a
+ * range without contours. Returns false if file cannot be read or out fails.
  */
-Mat drawMask(const Mat& src, const std::string& filename) {
-	//std::cout << "Building mask" << std::endl;
-	Mat mask; // Mask to be returned
-	mask = Mat::zeros(src.size(), CV_8UC1);
-
-	std::fstream filter(filename, std::fstream::in);
-	std::string line;
-
-	while (std::getline(filter, line)) {
-		bool fg;
-		//std::cout << line << "\n";
-
-		if (line[0] == '#' || line.size() == 0) {
-			continue;
-		} else if (line[0] == 'f') {
-			fg = true;
-		} else if (line[0] == 'b') {
-			fg = false;
-		} else {
-			std::cerr << "Error. First char of filter line is not 'f' or 'b'. Line: " << line << "\n";
-			exit(2);
+bool appendFile(const std::string& file, std::ostream& out) {
+	std::ifstream in(file, std::ios::in | std::ios::binary);
+	if (!in.is_open()) return false;
+	char block[1 << 16];
+	while (in) {
+		in.read(block, sizeof(block));
+		out.write(block, in.gcount());
+	}
+	return in.eof() && !in.bad() && bool(out);
+}
+
+/** Overlay video and polygon file of a run, or of one range of a video */
+struct OutputWriter {
+	VideoWriter video;
+	std::fstream poly;
+	std::unique_ptr<WktWriter> wkt; // Buffers the WKT text of poly
+	PolygonStreamWriter stream; // Polygons in binary format
+	FrameIndexWriter index; // Sidecar of either polygon file
+
+	/** Opens the outputs whose file name is not empty. Polygons are written
+	 * as WKT text for format "wkt", or else as a binary polygon stream, chain
+	 * coded for format "chain" and with edits between keyframes if given.
+	 */
+	void open(const std::string& video_file, const std::string& poly_file, double fps, Size size, const std::string& format,
+			int keyframes) {
+		if (!video_file.empty()) {
+			video = VideoWriter(video_file, VideoWriter::fourcc('F', 'M', 'P', '4'), fps, size);
 		}
+		if (!poly_file.empty()) {
+			if (format != "wkt") {
+				stream.open(poly_file, format == "chain", keyframes);
+			} else {
+				poly = std::fstream(poly_file, std::fstream::out);
+				wkt.reset(new WktWriter(poly));
+			}
+			index.open(frameIndexName(poly_file));
+		}
+	}
+
+	/** Offset the next polygon will be written at */
+	uint64_t tell() const {
+		return stream.isOpen() ? stream.tell() : wkt ? wkt->tell() : 0;
+	}
+
+	/** Writes the results of one frame. Frames without contours are skipped,
+	 * except by the index, which marks them as empty.
+	 * With several objects, each WKT line is keyed as "<frame> <object> <WKT>".
+	 */
+	void write(size_t index, double timestamp, const Segmentation& seg) {
+		static StageMetrics& encode_stage = metrics().stage("encode");
+		static StageMetrics& polygon_stage = metrics().stage("polygons");
+		metrics().addFrames();
+		if (memoryAccountingEnabled()) {
+			//Highest Mat memory held while the frame was in flight
+			static GaugeMetrics& mat_peak = metrics().gauge("mat_peak_bytes");
+			mat_peak.sample(takeMatPeak());
+		}
+
+		FrameEntry entry;
+		entry.frame = index;
+		entry.timestamp = timestamp;
+		entry.offset = entry.keyframe = tell();
+
+		if (seg.found()) {
+			if (video.isOpened()) {
+				StageTimer timer(encode_stage);
+				video << seg.segmented;
+			}
 
-		if (line[2] == 'p') { //Positional mask
-			std::stringstream ss(line);
-			ss.seekg(4);
-			int x, y;
-			ss >> x >> y;
-			//std::cout << "Adding point. Foreground(" << fg << "), Coords(" << x << "," << y <<")\n";
-			mask.at<unsigned char>(y, x) = (fg == true? 255 : 128);
-		} else if (line[2] == 'r') { //Rectangle
-			Point p1, p2;
-			std::stringstream ss(line);
-			ss.seekg(4);
-			int x, y;
-			ss >> x >> y;
-			p1.x = x;
-			p1.y = y;
-
-			ss >> x >> y;
-			p2.x = x;
-			p2.y = y;
-			//std::cout << "Adding rectangle. Foreground(" << fg << "), p1(" << p1.x << "," << p1.y <<")"
-			     //" p2(" << p2.x << "," << p2.y << ")\n";
-			rectangle(mask, p1, p2, (fg?255:128), -1);
-		} else if (line[2] == 'h') { //HSV mask filter
-			std::stringstream ss(line);
-			ss.seekg(4);
-
-			float hlow, slow, vlow;
-			float hhigh, shigh, vhigh;
-			unsigned short int openings;
-
-			ss >> openings >> hlow >> slow >> vlow >> hhigh >> shigh >> vhigh;
-			//std::cout << "Adding HSV filter. Foreground(" << fg << "). Openings(" << openings << "). "
-		//		"Low(" << hlow << "," << slow << "," << vlow << "). "
-		//		"High(" << hhigh << "," << shigh << "," << vhigh << ").\n";
-
-			Mat hsv_img, temp_bin;
-			cvtColor(src, hsv_img, COLOR_BGR2HSV); // Converts to HSV
-			inRange(hsv_img, Scalar(hlow, slow, vlow), Scalar(hhigh, shigh, vhigh), temp_bin);
-	
-			if (openings != 0) {
-				erode(temp_bin, temp_bin, Mat(), Point(-1, 1), openings);
-				dilate(temp_bin, temp_bin, Mat(), Point(-1, 1), openings);
+			StageTimer timer(polygon_stage);
+			if (stream.isOpen()) {
+				if (seg.objects.empty()) {
+					stream.write(index, timestamp, 1, seg.largest());
+				} else {
+					for (size_t k = 0; k < seg.objects.size(); ++k) {
+						if (seg.objects[k].empty()) continue;
+						stream.write(index, timestamp, k + 1, seg.objects[k]);
+					}
+				}
 			}
 
-			if (fg) {
-				add(mask, temp_bin, mask, noArray(), CV_8UC1);
-			} else { 
-				addWeighted(mask, 1, temp_bin, 0.5, 0, mask, CV_8UC1);
+			if (wkt && seg.objects.empty()) { //Saves largest contour
+				wkt->polygon(seg.largest());
+				wkt->text("\n");
+			} else if (wkt) {
+				for (size_t k = 0; k < seg.objects.size(); ++k) {
+					if (seg.objects[k].empty()) continue;
+					wkt->number(static_cast<long long>(index)).text(" ").number(static_cast<long long>(k + 1)).text(" ");
+					wkt->polygon(seg.objects[k]);
+					wkt->text("\n");
+				}
+			}
+
+			entry.polygons = seg.objects.empty() ? 1 : 0;
+			for (const std::vector<Point>& object : seg.objects) {
+				entry.polygons += !object.empty();
 			}
-		} else {
-			std::cerr << "Error. Unknown filter. Line: " << line << "\n";
-			exit(3);
+		}
+
+		if (this->index.isOpen()) {
+			entry.length = tell() - entry.offset;
+			if (stream.isOpen() && !entry.empty()) {
+				entry.keyframe = stream.keyframeOffset();
+			}
+			this->index.add(entry);
 		}
 	}
-	mask.convertTo(mask, CV_32SC1);
-	return mask;
+};
+
+/** Prints the final report and writes the metrics and trace files, if requested */
+bool finishMetrics(const cxxopts::ParseResult& result) {
+	metrics().report(std::cout, true);
+	bool ok = !result.count("metrics") || metrics().writeJson(result["metrics"].as<std::string>(), "auto_segmenter");
+	return (!result.count("trace") || writeTrace(result["trace"].as<std::string>())) && ok;
 }
 
 int main(int argc, char** argv) {
@@ -119,8 +173,20 @@ int main(int argc, char** argv) {
 		("v,video", "Input and output files are of type video. Cannot be used together with --image. One of either is obligatory.")
 		("m,media", "Input media.", cxxopts::value<std::string>())
 		("o,output", "Output file. Output will be written as the same type of input file.", cxxopts::value<std::string>())
-		("p,poly", "Output file. Output one WKT polygon per line.", cxxopts::value<std::string>())
-		("b,blur", "Blurres the image before applying segmentation. This option has no effect on outputs, just on contour definition.", cxxopts::value<std::string>());
+		("p,poly", "Output file. Output one WKT polygon per line. For videos, a frame index is written alongside as <file>.idx, see poly_convert --frame.", cxxopts::value<std::string>())
+		("poly_format", "Format of --poly in video mode: \"wkt\" for one WKT polygon per line, \"binary\" for a binary polygon stream or \"chain\" for a binary polygon stream with contours as Freeman chain codes, see poly_convert.", cxxopts::value<std::string>()->default_value("wkt"))
+		("keyframes", "With a binary --poly_format, writes each polygon as an edit of the one of the previous frame, with whole polygons every this many frames. 0 writes every polygon whole.", cxxopts::value<int>()->default_value("0"))
+		("b,blur", "Blurres the image before applying segmentation. This option has no effect on outputs, just on contour definition.", cxxopts::value<std::string>())
+		("t,threads", "Number of segmentation threads in video and batch modes. 0 uses one per hardware thread. With more than 1, video frames are decoded, segmented and written in a pipeline.", cxxopts::value<int>()->default_value("0"))
+		("batch", "Headless batch of images: a directory or a list file with one image per line. Replaces --image/--video and --media; --poly and --output are then directories, receiving <name>.wkt and an overlay with the input file name per image. No window is opened.", cxxopts::value<std::string>())
+		("segments", "Splits a video in this number of frame ranges, each decoded and segmented by its own thread into partial outputs that are stitched in order as the ranges finish. Takes precedence over --threads.", cxxopts::value<int>()->default_value("1"))
+		("track", "Tracking mode for videos: segments only the bounding box of the previous contour grown by this margin, in pixels, falling back to the full frame when the object touches the border or is lost. Negative disables it.", cxxopts::value<int>()->default_value("-1"))
+		("pyramid", "Pyramid level for video and batch modes: mask and watershed run on the frame reduced this many times by half, and only a band around the coarse boundary is refined at full resolution. 0 disables it.", cxxopts::value<int>()->default_value("0"))
+		("band", "Half width, in pixels, of the band refined at full resolution in pyramid mode.", cxxopts::value<int>()->default_value("4"))
+		("metrics", "Writes the timings of every stage, frame rate and queue depths of the run to this JSON file at the end.", cxxopts::value<std::string>())
+		("report_interval", "Seconds between progress reports with the mean time of every stage so far.", cxxopts::value<double>()->default_value("5"))
+		("memory", "Counts the bytes and number of allocations of Mat data and of the heap, per stage and per frame, and the peak resident Mat memory. They are printed at the end and written to --metrics.")
+		("trace", "Writes every stage and frame of the run, per thread, to this file in the Chrome trace event format, viewable in chrome://tracing or ui.perfetto.dev.", cxxopts::value<std::string>());
 
 	if (argc==1) {
 		std::cout << options.help() << std::endl;
@@ -147,24 +213,77 @@ int main(int argc, char** argv) {
 			"    s_high=param[5]\n"
 			"    v_high=param[6]\n";
 		std::cout << "  Positional: \'p\'. Accepts 2 parameters, x and y of position.\n";
+		std::cout << "  Rectangle: \'r\'. Accepts 4 parameters, x and y of two opposite corners.\n";
+		std::cout << "Several objects can be extracted in a single pass by adding an object ID to the foreground ROI, e.g. \'f2 h ...\'.\n"
+			"Plain \'f\' is object 1. With more than one object, video polygon lines are written as <frame> <object> <WKT>.\n";
 		return 0;
 	}
 
+	metrics().setInterval(result["report_interval"].as<double>());
+	if (result["memory"].as<bool>()) {
+		enableMemoryAccounting();
+	}
+	if (result.count("trace")) {
+		enableTracing();
+		setTraceThreadName("main");
+	}
+
+	bool batch = result.count("batch") != 0;
+	if (batch && (result["image"].as<bool>() || result["video"].as<bool>())) {
+		std::cout << "Cannot use --batch together with --image or --video.\n";
+		return 1;
+	}
+
 	if (result["image"].as<bool>() && result["video"].as<bool>()) {
 		std::cout << "Cannot use both --image and --video options together.\n";
 		return 1;
 	}
 
-	if (!(result["image"].as<bool>() || result["video"].as<bool>())) {
+	if (!batch && !(result["image"].as<bool>() || result["video"].as<bool>())) {
 		std::cout << "One of --image or --video is mandatory.\n";
 		return 2;
 	}
 
-	if (!result.count("media") && !result.count("filter")) {
+	if (!result.count("filter") || (!batch && !result.count("media"))) {
 		std::cout << "Error. Need to specify input and filter file.\n";
 		return 3;
 	}
 
+	//Parses the filter once, so errors are reported before any frame is processed
+	FilterProgram filter;
+	int filter_error = filter.load(result["filter"].as<std::string>());
+	if (filter_error != 0) {
+		return filter_error;
+	}
+
+	if (batch) { //Headless: no window is opened, so it runs on nodes without a display
+		std::vector<std::string> images = listImages(result["batch"].as<std::string>());
+		if (images.empty()) {
+			std::cout << "Error. No images found in " << result["batch"].as<std::string>() << ".\n";
+			return 2;
+		}
+
+		BatchOptions opts;
+		opts.poly_dir = result.count("poly") ? result["poly"].as<std::string>() : "";
+		opts.overlay_dir = result.count("output") ? result["output"].as<std::string>() : "";
+		opts.threads = result["threads"].as<int>();
+		opts.segment.approx = CHAIN_APPROX_NONE;
+		if (result.count("b")) {
+			opts.segment.blur = std::stoi(result["b"].as<std::string>());
+			std::cout << "Blur size: " << opts.segment.blur << std::endl;
+		}
+		opts.segment.band = result["band"].as<int>();
+		opts.pyramid_level = result["pyramid"].as<int>();
+
+		std::cout << "Processing " << images.size() << " images\n";
+		BatchSummary summary = runBatch(filter, images, opts);
+		std::cout << "Processed " << summary.processed << " images: " << summary.unreadable << " unreadable, "
+			<< summary.rejected << " not fitting the filter, " << summary.empty << " without contour, "
+			<< summary.write_errors << " write errors.\n";
+		if (!finishMetrics(result)) return 5;
+		return summary.write_errors > 0 ? 5 : 0;
+	}
+
 	if (result["image"].as<bool>()) {
 		Mat image; // Original image
 		image = imread(result["media"].as<std::string>());
@@ -173,8 +292,12 @@ int main(int argc, char** argv) {
 			exit(2);
 		}
 
+		if (!filter.rasterize(image.size())) {
+			exit(4);
+		}
+
 		Mat mask; // Mask to hold the values
-		mask = drawMask(image, result["filter"].as<std::string>());
+		filter.execute(image, mask);
 
 		// Shows pre-segmentation mask
 		{
@@ -208,19 +331,8 @@ int main(int argc, char** argv) {
 
 		//Finds the largest contour
 		std::vector<std::vector<Point>> vertexes;
-		Mat binary;
-		mask.convertTo(binary, CV_32FC1);
-		threshold(binary, binary, 200, 255, THRESH_BINARY);
-		binary.convertTo(binary, CV_8UC1);
-		findContours(binary, vertexes, RETR_EXTERNAL, CHAIN_APPROX_NONE);
-		size_t biggest = 0;
-		size_t biggest_size = 0;
-		for (size_t i = 0; i < vertexes.size(); ++i) {
-			if (vertexes[i].size() > biggest_size) {
-				biggest = i;
-				biggest_size = vertexes[i].size();
-			}
-		}
+		traceLabelContours(mask, FilterProgram::FG_THRESHOLD + 1, INT_MAX, vertexes, CHAIN_APPROX_NONE);
+		size_t biggest = largestContour(vertexes);
 
 		// Generates the overlay
 		Mat segmented; // Segmented image with the overlay
@@ -235,13 +347,8 @@ int main(int argc, char** argv) {
 
 		if (result.count("poly")) { //Saves largest contour
 
-			//Saves it to a Polygon, then to WKT
-			Polygon pol;
-			for (Point p : vertexes[biggest]) {
-				pol.points.emplace_back(p.x, p.y);
-			}
 			std::fstream fs(result["poly"].as<std::string>(), std::fstream::out);
-			pol.save(fs, Polygon::FileType::FILE_WKT);
+			WktWriter(fs).polygon(vertexes[biggest]);
 		}
 
 		/** Checks contour. Uncomment to wait for q press showing windows.
@@ -252,81 +359,172 @@ int main(int argc, char** argv) {
 		Mat cur_frame;
 		VideoCapture vid(result["media"].as<std::string>());
 		double max_frames = vid.get(CAP_PROP_FRAME_COUNT);
+		metrics().setExpectedFrames(max_frames > 0 ? max_frames : 0);
 
-		//Output video
-		VideoWriter w;
+		if (!filter.rasterize(Size(vid.get(CAP_PROP_FRAME_WIDTH), vid.get(CAP_PROP_FRAME_HEIGHT)), result["pyramid"].as<int>())) {
+			exit(4);
+		}
+
+		std::string video_file = result.count("output") ? result["output"].as<std::string>() : "";
+		std::string poly_file = result.count("poly") ? result["poly"].as<std::string>() : "";
+		double fps = vid.get(CAP_PROP_FPS);
+
+		//Output video and polygons
+		OutputWriter out;
+		Size frame_size;
 		if (result.count("output")) {
 			vid >> cur_frame; // Pre-read first frame to get sizes
-			w = VideoWriter(result["output"].as<std::string>(), VideoWriter::fourcc('F', 'M', 'P', '4'),
-					vid.get(CAP_PROP_FPS), cur_frame.size());
+			frame_size = cur_frame.size();
 			vid.set(CAP_PROP_POS_FRAMES, 0);
 		}
-
-		//Output polygons
-		std::fstream fs;
-		if (result.count("poly")) {
-			fs = std::fstream(result["poly"].as<std::string>(), std::fstream::out);
+		const std::string poly_format = result["poly_format"].as<std::string>();
+		if (poly_format != "wkt" && poly_format != "binary" && poly_format != "chain") {
+			std::cout << "Error. Unknown polygon format " << poly_format << ".\n";
+			return 1;
 		}
+		const bool binary = poly_format != "wkt";
+		const int keyframes = result["keyframes"].as<int>();
+		out.open(video_file, poly_file, fps, frame_size, poly_format, keyframes);
 
-		while (vid.read(cur_frame)) {
-			//vid >> cur_frame;
-
-			Mat mask; // Mask to hold the values
-			mask = drawMask(cur_frame, result["filter"].as<std::string>());
+		SegmentOptions opts;
+		if (result.count("b")) {
+			opts.blur = std::stoi(result["b"].as<std::string>());
+			std::cout << "Blur size: " << opts.blur << std::endl;
+		}
+		opts.overlay = result.count("output") != 0;
+		//Chain codes need every step of the contour, which SIMPLE drops
+		if (poly_format == "chain") {
+			opts.approx = CHAIN_APPROX_NONE;
+		}
+		opts.track_margin = result["track"].as<int>();
+		opts.band = result["band"].as<int>();
 
-			Mat proc; //Frame to be processed; can be blurred
+		int threads = result["threads"].as<int>();
+		if (threads <= 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		int segments = result["segments"].as<int>();
+		if (segments > 1) {
+			//Each range has its own decoder and partial outputs, stitched in order as they finish
+			vid.release();
+			std::vector<FrameRange> ranges = splitVideo(result["media"].as<std::string>(), segments);
+			std::cout << "Processing " << ranges.size() << " ranges\n";
+
+			//Overlay parts are lossless, so the stitched video is only encoded
+			//once. A part falls back to the codec of the output if FFV1 cannot
+			//be written.
+			std::vector<std::string> video_parts(ranges.size());
+			std::vector<std::thread> workers;
+			for (size_t k = 0; k < ranges.size(); ++k) {
+				workers.emplace_back([&, k]() {
+					setTraceThreadName("range " + std::to_string(k));
+					VideoCapture range_vid(result["media"].as<std::string>());
+					range_vid.set(CAP_PROP_POS_FRAMES, ranges[k].begin);
+
+					OutputWriter part;
+					part.open("", poly_file.empty() ? "" : partName(poly_file, k), fps, frame_size, poly_format, keyframes);
+					if (!video_file.empty()) {
+						video_parts[k] = partName(video_file, k) + ".avi";
+						if (!part.video.open(video_parts[k], VideoWriter::fourcc('F', 'F', 'V', '1'), fps, frame_size)) {
+							video_parts[k] = partName(video_file, k);
+							part.video.open(video_parts[k], VideoWriter::fourcc('F', 'M', 'P', '4'), fps, frame_size);
+						}
+					}
 
-			if (result.count("b")) {
-				int size = std::stoi(result["b"].as<std::string>());
-				std::cout << "Blur size: " << size << std::endl;
-				blur(cur_frame, proc, Size(size, size));
-			} else {
-				proc = cur_frame;
+					Mat frame;
+					Segmentation seg;
+					FrameBuffers buffers;
+					TrackState state;
+					for (size_t i = ranges[k].begin; i < ranges[k].end && readFrame(range_vid, frame); ++i) {
+						TraceFrame trace(i);
+						if (opts.track_margin >= 0) {
+							segmentTracked(filter, frame, opts, state, buffers, seg);
+						} else {
+							segmentFrame(filter, frame, opts, buffers, seg);
+						}
+						part.write(i, range_vid.get(CAP_PROP_POS_MSEC), seg);
+						metrics().report(std::cout);
+					}
+				});
 			}
 
-			watershed(proc, mask);
-
-			//Finds the largest contour
-			std::vector<std::vector<Point>> vertexes;
-			Mat binary;
-			mask.convertTo(binary, CV_32FC1);
-			threshold(binary, binary, 200, 255, THRESH_BINARY);
-			binary.convertTo(binary, CV_8UC1);
-			findContours(binary, vertexes, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-
-			if (vertexes.size() != 0) {
-				size_t biggest = 0;
-				size_t biggest_size = 0;
-				for (size_t i = 0; i < vertexes.size(); ++i) {
-					if (vertexes[i].size() > biggest_size) {
-						biggest = i;
-						biggest_size = vertexes[i].size();
+			//Stitches the partial outputs of a finished range
+			auto stitch = [&](size_t k) {
+				if (!poly_file.empty()) {
+					std::string part_file = partName(poly_file, k);
+					uint64_t base;
+					bool appended;
+					if (binary) {
+						base = out.stream.tell() - POLYGON_STREAM_HEADER_SIZE; //Header of the part is not copied
+						appended = out.stream.append(part_file);
+					} else {
+						out.wkt->flush();
+						base = out.poly.tellp();
+						appended = appendFile(part_file, out.poly);
 					}
+					if (!appended || !out.index.append(frameIndexName(part_file), base)) {
+						std::cout << "Error. Could not append " << part_file << " to " << poly_file << ".\n";
+						return false;
+					}
+					std::remove(part_file.c_str());
+					std::remove(frameIndexName(part_file).c_str());
 				}
-
-				if (result.count("output")) { // Generates the overlay
-					// Generates the overlay
-					Mat segmented; // Segmented image with the overlay
-					cur_frame.convertTo(segmented, CV_8UC3);
-					drawContours(segmented, vertexes, biggest, Scalar(255, 255, 255), -1);
-					addWeighted(segmented, 0.5, cur_frame, 0.5, 0, segmented, CV_8UC3);
-					w << segmented;
-				}
-
-				if (result.count("poly")) { //Saves largest contour
-					Polygon pol;
-					for (Point p : vertexes[biggest]) {
-						pol.points.emplace_back(p.x, p.y);
+				if (!video_file.empty()) {
+					{
+						VideoCapture part(video_parts[k]);
+						Mat frame;
+						while (part.read(frame)) {
+							out.video << frame;
+						}
 					}
-					pol.save(fs, Polygon::FileType::FILE_WKT);
-					fs << "\n";
+					std::remove(video_parts[k].c_str());
 				}
+				return true;
+			};
+
+			//Each range is stitched as soon as it is done, while the later
+			//ones are still running. After an error the rest are only joined.
+			bool stitched = true;
+			for (size_t k = 0; k < workers.size(); ++k) {
+				workers[k].join();
+				std::cout << (k + 1) * 100 / ranges.size() << "\% " << std::endl;
+				stitched = stitched && stitch(k);
+			}
+			if (!stitched) return 9;
+		} else if (threads <= 1 || opts.track_margin >= 0) {
+			if (threads > 1 && result.count("threads")) {
+				std::cout << "Tracking needs frames in order. Ignoring --threads.\n";
 			}
 
-			std::cout << vid.get(CAP_PROP_POS_FRAMES) * 100 / max_frames
-				<< "\% "
-				<< std::endl;
+			Segmentation seg;
+			FrameBuffers buffers;
+			TrackState state;
+			size_t index = 0;
+			while (readFrame(vid, cur_frame)) {
+				TraceFrame trace(index);
+				if (opts.track_margin >= 0) {
+					segmentTracked(filter, cur_frame, opts, state, buffers, seg);
+				} else {
+					segmentFrame(filter, cur_frame, opts, buffers, seg);
+				}
+				out.write(index++, vid.get(CAP_PROP_POS_MSEC), seg);
+				metrics().report(std::cout);
+			}
+		} else { //Decoder thread, segmentation workers and ordered writer on this thread
+			std::vector<FrameBuffers> buffers(threads);
+			runPipeline([&](PipelineItem& item) {
+						if (!readFrame(vid, item.frame)) return false;
+						item.timestamp = vid.get(CAP_PROP_POS_MSEC);
+						return true;
+					},
+					[&](PipelineItem& item, size_t worker) { segmentFrame(filter, item.frame, opts, buffers[worker], item.result); },
+					[&](PipelineItem& item) {
+						out.write(item.index, item.timestamp, item.result);
+						metrics().report(std::cout);
+					},
+					threads, 4 * threads);
 		}
+
 	}
-	return 0;
+	return finishMetrics(result) ? 0 : 5;
 }
@@ -0,0 +1,239 @@
+#include "batch_segmenter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "metrics.hpp"
+#include "wkt_writer.hpp"
+
+using namespace cv;
+
+namespace {
+
+const char* IMAGE_EXTENSIONS[] = {"bmp", "jpeg", "jpg", "png", "pgm", "ppm", "tif", "tiff", "webp"};
+
+/** Returns the lower case extension of filename, without the dot */
+std::string extension(const std::string& filename) {
+	size_t slash = filename.find_last_of("/\\");
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return "";
+
+	std::string ext = filename.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+	return ext;
+}
+
+/** Returns the file name of path, without directories */
+std::string baseName(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/** Returns the file name of path, without directories and extension */
+std::string stem(const std::string& path) {
+	std::string name = baseName(path);
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+std::string joinPath(const std::string& dir, const std::string& name) {
+	if (dir.empty() || dir.back() == '/') return dir + name;
+	return dir + "/" + name;
+}
+
+/** Output names of images, without extension: their stem if no other image
+ * has it, or else their path flattened with '_', which is unique
+ */
+std::vector<std::string> outputNames(const std::vector<std::string>& images) {
+	std::map<std::string, size_t> stems;
+	for (const std::string& f: images) {
+		++stems[stem(f)];
+	}
+
+	std::vector<std::string> names;
+	names.reserve(images.size());
+	for (const std::string& f: images) {
+		if (stems[stem(f)] == 1) {
+			names.push_back(stem(f));
+			continue;
+		}
+		const size_t start = f.find_first_not_of("./\\");
+		std::string name = start == std::string::npos ? f : f.substr(start);
+		std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == '.' || c == ':'; }, '_');
+		names.push_back(name);
+	}
+	return names;
+}
+
+/** Filter programs rasterized for every image size seen so far. Copies share
+ * the lookup tables, so only the fixed layers are built again.
+ */
+class FilterCache {
+	public:
+		FilterCache(const FilterProgram& filter, int pyramid_level) : filter(filter), pyramid_level(pyramid_level) {}
+
+		/** Returns the program for frames of size s, or nullptr if the filter
+		 * does not fit them. Rasterization errors are reported once per size.
+		 */
+		std::shared_ptr<const FilterProgram> get(const Size& s) {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = programs.find(std::make_pair(s.width, s.height));
+			if (it != programs.end()) return it->second;
+
+			std::shared_ptr<FilterProgram> program = std::make_shared<FilterProgram>(filter);
+			if (!program->rasterize(s, pyramid_level)) {
+				program.reset();
+			}
+			programs[std::make_pair(s.width, s.height)] = program;
+			return program;
+		}
+
+	private:
+		const FilterProgram& filter;
+		int pyramid_level;
+		std::mutex mutex;
+		std::map<std::pair<int, int>, std::shared_ptr<const FilterProgram>> programs;
+};
+
+}
+
+std::vector<std::string> listImages(const std::string& path) {
+	std::vector<std::string> images;
+
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		std::cerr << "Error. Could not access " << path << ".\n";
+		return images;
+	}
+
+	if (S_ISDIR(info.st_mode)) {
+		std::vector<std::string> files;
+		glob(path, files, false);
+		for (const std::string& f: files) {
+			std::string ext = extension(f);
+			if (std::find(std::begin(IMAGE_EXTENSIONS), std::end(IMAGE_EXTENSIONS), ext) != std::end(IMAGE_EXTENSIONS)) {
+				images.push_back(f);
+			}
+		}
+	} else {
+		std::ifstream list(path);
+		std::string line;
+		while (std::getline(list, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) images.push_back(line);
+		}
+	}
+	return images;
+}
+
+BatchSummary runBatch(const FilterProgram& filter, const std::vector<std::string>& images, const BatchOptions& opts) {
+	FilterCache cache(filter, opts.pyramid_level);
+	SegmentOptions seg_opts = opts.segment;
+	seg_opts.overlay = !opts.overlay_dir.empty();
+
+	const std::vector<std::string> names = outputNames(images);
+	size_t renamed = 0;
+	for (size_t i = 0; i < images.size(); ++i) {
+		renamed += names[i] != stem(images[i]);
+	}
+	if (renamed) {
+		std::cerr << renamed << " images share their file name with another, their outputs are named after their whole path.\n";
+	}
+
+	std::atomic<size_t> next(0), done(0);
+	std::atomic<size_t> unreadable(0), rejected(0), empty(0), write_errors(0);
+	std::mutex out_mutex; // Serializes messages and progress
+
+	auto report = [&](const std::string& msg) {
+		std::lock_guard<std::mutex> lock(out_mutex);
+		std::cerr << msg << "\n";
+	};
+
+	//Each worker takes the next image until there are none left, so slow
+	//images do not hold a fixed share of the batch
+	static StageMetrics& decode_stage = metrics().stage("decode");
+	static StageMetrics& write_stage = metrics().stage("write");
+	metrics().setExpectedFrames(images.size());
+
+	auto worker = [&]() {
+		Segmentation seg;
+		FrameBuffers buffers;
+		for (size_t i = next++; i < images.size(); i = next++) {
+			const std::string& file = images[i];
+			Mat image;
+			{
+				StageTimer timer(decode_stage);
+				image = imread(file, IMREAD_COLOR);
+			}
+			if (image.empty()) {
+				++unreadable;
+				report("Error - could not read file " + file + " as image.");
+			} else {
+				std::shared_ptr<const FilterProgram> program = cache.get(image.size());
+				if (!program) {
+					++rejected;
+					report("Error - filter does not fit " + file + ".");
+				} else {
+					segmentFrame(*program, image, seg_opts, buffers, seg);
+					if (!seg.found()) {
+						++empty;
+						report("No contour found in " + file + ".");
+					} else {
+						StageTimer timer(write_stage);
+						if (!opts.poly_dir.empty()) {
+							std::fstream fs(joinPath(opts.poly_dir, names[i] + ".wkt"), std::fstream::out);
+							WktWriter(fs).polygon(seg.largest());
+							if (!fs) {
+								++write_errors;
+								report("Error - could not write polygon of " + file + ".");
+							}
+						}
+						if (!opts.overlay_dir.empty() && !imwrite(joinPath(opts.overlay_dir, names[i] + baseName(file).substr(stem(file).size())), seg.segmented)) {
+							++write_errors;
+							report("Error - could not write overlay of " + file + ".");
+						}
+					}
+				}
+			}
+
+			++done;
+			metrics().addFrames();
+			{
+				std::lock_guard<std::mutex> lock(out_mutex);
+				metrics().report(std::cout);
+			}
+		}
+	};
+
+	size_t n = opts.threads > 0 ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for (size_t k = 1; k < n; ++k) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& t: workers) {
+		t.join();
+	}
+
+	BatchSummary summary;
+	summary.processed = done;
+	summary.unreadable = unreadable;
+	summary.rejected = rejected;
+	summary.empty = empty;
+	summary.write_errors = write_errors;
+	return summary;
+}
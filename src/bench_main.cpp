@@ -0,0 +1,524 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "cxxopts.hpp"
+#include "filter_program.hpp"
+#include "frame_segmenter.hpp"
+#include "label_contours.hpp"
+#include "metrics.hpp"
+#include "morphology.hpp"
+#include "trace.hpp"
+#include "visvalingam.hpp"
+#include "wkt_reader.hpp"
+#include "wkt_writer.hpp"
+
+using namespace cv;
+
+namespace {
+
+long long msSince(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+long long nsSince(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Opens media, printing an error if it cannot */
+bool openMedia(const cxxopts::ParseResult& result, VideoCapture& media) {
+	if (!result.count("media")) {
+		std::cout << "Error. Need to specify --media.\n";
+		return false;
+	}
+	if (!media.open(result["media"].as<std::string>())) {
+		std::cout << "Error - could not read file " << result["media"].as<std::string>() << ".\n";
+		return false;
+	}
+	return true;
+}
+
+/** Reads the first frame of media, printing an error if it cannot */
+bool firstFrame(const cxxopts::ParseResult& result, Mat& frame) {
+	VideoCapture media;
+	if (!openMedia(result, media)) return false;
+	if (!media.read(frame)) {
+		std::cout << "Error - could not read file " << result["media"].as<std::string>() << ".\n";
+		return false;
+	}
+	return true;
+}
+
+/** Times openRect() against iterated 3x3 erode/dilate on plane for 1, 2, 4, ...
+ * up to max_iterations, printing one line per count. Returns false if any
+ * result differs.
+ */
+bool benchmarkOpenings(const Mat& plane, int max_iterations) {
+	const int REPEAT = 10;
+	bool equal = true;
+	std::cout << "openings\terode/dilate (ms)\topenRect (ms)\n";
+	MorphologyBuffers buffers;
+	for (int n = 1; n <= max_iterations; n *= 2) {
+		Mat reference, running;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int k = 0; k < REPEAT; ++k) {
+			erode(plane, reference, Mat(), Point(-1, -1), n);
+			dilate(reference, reference, Mat(), Point(-1, -1), n);
+		}
+		long long reference_ms = msSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int k = 0; k < REPEAT; ++k) {
+			openRect(plane, running, n, buffers);
+		}
+		long long running_ms = msSince(start);
+
+		std::cout << n << "\t" << reference_ms / double(REPEAT) << "\t" << running_ms / double(REPEAT);
+		if (norm(reference, running, NORM_INF) != 0) {
+			std::cout << "\tDIFFERS";
+			equal = false;
+		}
+		std::cout << std::endl;
+	}
+	return equal;
+}
+
+/** Distance from every point of a to the outline of b */
+void addDeviation(const std::vector<Point>& a, const std::vector<Point>& b, double& max_deviation, double& sum) {
+	Rect box = boundingRect(a) | boundingRect(b);
+	Mat outline(box.size(), CV_8UC1, Scalar(255)), dist;
+	std::vector<std::vector<Point>> contours(1, b);
+	drawContours(outline, contours, 0, Scalar(0), 1, LINE_8, noArray(), INT_MAX, -box.tl());
+	distanceTransform(outline, dist, DIST_L2, DIST_MASK_PRECISE);
+	for (const Point& p: a) {
+		double d = dist.at<float>(p - box.tl());
+		max_deviation = std::max(max_deviation, d);
+		sum += d;
+	}
+}
+
+/** Segments up to max_frames frames of media both at full resolution and
+ * through the pyramid of level, and prints the time of both and how far the
+ * pyramid contours deviate from the full resolution ones. Returns false if
+ * the filter cannot be rasterized for media.
+ */
+bool benchmarkPyramid(const FilterProgram& filter, VideoCapture& media, int level, int band, int max_frames) {
+	const Size size(media.get(CAP_PROP_FRAME_WIDTH), media.get(CAP_PROP_FRAME_HEIGHT));
+	FilterProgram full = filter, pyramid = filter;
+	if (!full.rasterize(size) || !pyramid.rasterize(size, level)) return false;
+
+	SegmentOptions opts;
+	opts.band = band;
+	FrameBuffers full_buffers, pyramid_buffers;
+	Segmentation reference, out;
+	long long frames = 0, full_ns = 0, pyramid_ns = 0, points = 0, mismatched = 0;
+	double max_deviation = 0, sum = 0;
+
+	//Symmetric distance between the largest contours, or between the contours of each object
+	auto measure = [&](const std::vector<Point>& a, const std::vector<Point>& b) {
+		if (a.empty() != b.empty()) {
+			++mismatched;
+		} else if (!a.empty()) {
+			addDeviation(a, b, max_deviation, sum);
+			addDeviation(b, a, max_deviation, sum);
+			points += a.size() + b.size();
+		}
+	};
+
+	Mat frame;
+	while (frames < max_frames && media.read(frame)) {
+		auto start = std::chrono::steady_clock::now();
+		segmentFrame(full, frame, opts, full_buffers, reference);
+		full_ns += nsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		segmentFrame(pyramid, frame, opts, pyramid_buffers, out);
+		pyramid_ns += nsSince(start);
+
+		if (filter.object_count > 1) {
+			for (size_t k = 0; k < out.objects.size(); ++k) {
+				measure(out.objects[k], reference.objects[k]);
+			}
+		} else {
+			measure(out.found() ? out.largest() : std::vector<Point>(), reference.found() ? reference.largest() : std::vector<Point>());
+		}
+		++frames;
+	}
+
+	std::cout << "Pyramid level " << level << " over " << frames << " frames: pyramid "
+		<< pyramid_ns / 1e6 << " ms, full resolution " << full_ns / 1e6 << " ms\n";
+	std::cout << "Contour deviation from full resolution: max " << max_deviation << " px, mean "
+		<< (points ? sum / points : 0) << " px, " << mismatched << " objects found by only one of them\n";
+	return true;
+}
+
+/** Times the foreground contours of labels, traced straight from the labels
+ * and through the convertTo/threshold/convertTo/findContours chain tracing
+ * replaced, repeat times each, adding to traced_ns and chain_ns. Returns
+ * false if the contours differ.
+ */
+bool timeContours(const Mat& labels, int repeat, long long& traced_ns, long long& chain_ns) {
+	std::vector<std::vector<Point>> traced, chained;
+	std::vector<signed char> buffer;
+	Mat real, binary;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int k = 0; k < repeat; ++k) {
+		traceLabelContours(labels, FilterProgram::FG_THRESHOLD + 1, INT_MAX, traced, CHAIN_APPROX_NONE, Point(), buffer);
+	}
+	traced_ns += nsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int k = 0; k < repeat; ++k) {
+		labels.convertTo(real, CV_32F);
+		threshold(real, real, FilterProgram::FG_THRESHOLD, 255, THRESH_BINARY);
+		real.convertTo(binary, CV_8U);
+		findContours(binary, chained, RETR_EXTERNAL, CHAIN_APPROX_NONE);
+	}
+	chain_ns += nsSince(start);
+
+	return traced == chained;
+}
+
+/** Label image like the watershed markers of a frame of size: background and
+ * unknown labels under FG_THRESHOLD, and object ellipses, some with holes
+ */
+Mat syntheticLabels(Size size) {
+	Mat labels(size, CV_32SC1);
+	RNG rng(1);
+	rng.fill(labels, RNG::UNIFORM, 0, FilterProgram::FG_THRESHOLD + 1);
+	for (int k = 0; k < 40; ++k) {
+		const Point centre(rng.uniform(0, size.width), rng.uniform(0, size.height));
+		const Size axes(rng.uniform(1, size.width / 8), rng.uniform(1, size.height / 8));
+		ellipse(labels, centre, axes, rng.uniform(0, 180), 0, 360, Scalar(FilterProgram::objectLabel(1 + k % 3)), FILLED);
+		if (k % 4 == 0) {
+			ellipse(labels, centre, Size(axes.width / 2, axes.height / 2), 0, 0, 360, Scalar(0), FILLED);
+		}
+	}
+	return labels;
+}
+
+/** Times contour extraction on a synthetic label image of the frame size of
+ * media, or 1920x1080 without media, and on the watershed markers of up to
+ * max_frames frames of media segmented with filter. Returns false if any
+ * contours differ.
+ */
+bool benchmarkContours(const FilterProgram* filter, VideoCapture* media, int repeat, int max_frames) {
+	Size size(1920, 1080);
+	if (media) {
+		size = Size(media->get(CAP_PROP_FRAME_WIDTH), media->get(CAP_PROP_FRAME_HEIGHT));
+	}
+	bool same = true;
+	long long traced_ns = 0, chain_ns = 0;
+	same = timeContours(syntheticLabels(size), repeat, traced_ns, chain_ns) && same;
+	std::cout << "Synthetic " << size.width << "x" << size.height << " labels: traced "
+		<< traced_ns / 1e6 / repeat << " ms, findContours chain " << chain_ns / 1e6 / repeat << " ms\n";
+	if (!media) return same;
+
+	FilterProgram rasterized = *filter;
+	if (!rasterized.rasterize(size)) return false;
+	Mat frame, markers;
+	long long frames = 0;
+	traced_ns = chain_ns = 0;
+	while (frames < max_frames && media->read(frame)) {
+		rasterized.execute(frame, markers);
+		watershed(frame, markers);
+		same = timeContours(markers, repeat, traced_ns, chain_ns) && same;
+		++frames;
+	}
+	if (frames) {
+		std::cout << "Markers of " << frames << " frames: traced " << traced_ns / 1e6 / (frames * repeat)
+			<< " ms, findContours chain " << chain_ns / 1e6 / (frames * repeat) << " ms per frame\n";
+	}
+	if (!same) {
+		std::cout << "Error. Traced contours differ from findContours.\n";
+	}
+	return same;
+}
+
+/** Writes a polygon of the given number of vertices through WktWriter and
+ * through iostream, timing both and checking integer output is identical.
+ * Returns false on a difference.
+ */
+bool benchmarkWktWriter(size_t vertices) {
+	//Random walk, like a contour of a large object
+	std::vector<Point> points(vertices);
+	std::vector<Point2d> real_points(vertices);
+	RNG rng(1);
+	Point p(100000, 100000);
+	for (size_t i = 0; i < vertices; ++i) {
+		p += Point(rng.uniform(-1, 2), rng.uniform(-1, 2));
+		points[i] = p;
+		real_points[i] = Point2d(615202.199 + p.x * 0.187, 4583991.175 - p.y * 0.187);
+	}
+
+	std::ostringstream stream_int, writer_int, stream_real, writer_real;
+
+	auto start = std::chrono::steady_clock::now();
+	stream_int << "POLYGON ((";
+	for (size_t i = 0; i < points.size(); ++i) {
+		stream_int << (i ? ", " : "") << points[i].x << " " << points[i].y;
+	}
+	stream_int << ", " << points[0].x << " " << points[0].y << "))\n";
+	long long stream_int_ms = msSince(start);
+
+	start = std::chrono::steady_clock::now();
+	{
+		WktWriter writer(writer_int, WKT_SPACED);
+		writer.polygon(points);
+		writer.text("\n");
+	}
+	long long writer_int_ms = msSince(start);
+
+	start = std::chrono::steady_clock::now();
+	stream_real.precision(17);
+	stream_real << "POLYGON ((";
+	for (size_t i = 0; i < real_points.size(); ++i) {
+		stream_real << (i ? ", " : "") << real_points[i].x << " " << real_points[i].y;
+	}
+	stream_real << ", " << real_points[0].x << " " << real_points[0].y << "))\n";
+	long long stream_real_ms = msSince(start);
+
+	start = std::chrono::steady_clock::now();
+	{
+		WktWriter writer(writer_real, WKT_SPACED);
+		writer.polygon(real_points);
+		writer.text("\n");
+	}
+	long long writer_real_ms = msSince(start);
+
+	std::cout << "WKT of " << vertices << " vertices\tiostream (ms)\tWktWriter (ms)\n";
+	std::cout << "integer\t" << stream_int_ms << "\t" << writer_int_ms << "\n";
+	std::cout << "double\t" << stream_real_ms << "\t" << writer_real_ms << "\n";
+
+	if (stream_int.str() != writer_int.str()) {
+		std::cout << "Error. Integer output differs from iostream.\n";
+		return false;
+	}
+	return true;
+}
+
+/** Parses every polygon of filename and prints the throughput in MB/s.
+ * Returns false if the file could not be read to its end.
+ */
+bool benchmarkWktReader(const std::string& filename) {
+	WktReader reader;
+	if (!reader.open(filename)) return false;
+
+	auto start = std::chrono::steady_clock::now();
+	WktPolygon polygon;
+	size_t polygons = 0, vertices = 0;
+	while (reader.next(polygon)) {
+		++polygons;
+		vertices += polygon.points.size();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double mb = reader.tell() / 1e6;
+	std::cout << "Parsed " << polygons << " polygons, " << vertices << " vertices, " << mb << " MB in "
+		<< seconds * 1000 << " ms: " << (seconds > 0 ? mb / seconds : 0) << " MB/s\n";
+	return reader.atEnd();
+}
+
+/** Times n empty StageTimers with tracing disabled and enabled against the
+ * same clock reads and histogram update without any trace check, printing
+ * the cost of each in ns. Returns false if a timer with tracing disabled
+ * costs over 10% (and 2 ns) more than the metrics alone.
+ */
+bool benchmarkTracing(size_t n) {
+	StageMetrics stage("benchmark");
+	const bool was_enabled = tracingEnabled();
+
+	auto perTimer = [n](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+	};
+
+	//Same work as StageTimer, without looking at the trace
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		auto t0 = std::chrono::steady_clock::now();
+		stage.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+	}
+	const double metrics_only = perTimer(start);
+
+	enableTracing(false);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		StageTimer timer(stage);
+	}
+	const double disabled = perTimer(start);
+
+	enableTracing(true);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		StageTimer timer(stage);
+	}
+	const double enabled = perTimer(start);
+
+	enableTracing(was_enabled);
+
+	std::cout << "StageTimer over " << n << " scopes: metrics only " << metrics_only << " ns, tracing disabled "
+		<< disabled << " ns, tracing enabled " << enabled << " ns\n";
+	return disabled <= metrics_only * 1.1 + 2;
+}
+
+/** Noisy circle of n points, the same for every n and seed */
+Polygon noisyCircle(size_t n, unsigned seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> noise(-1, 1);
+	Polygon polygon;
+	polygon.points.reserve(n);
+	const double radius = n / 8.0 + 10;
+	for (size_t k = 0; k < n; ++k) {
+		const double angle = 2 * M_PI * k / n;
+		const double r = radius + 4 * noise(rng);
+		//Integer coordinates, as contours have, so many areas tie
+		SimplePoint p;
+		p.x = std::round(r * std::cos(angle));
+		p.y = std::round(r * std::sin(angle));
+		polygon.points.push_back(p);
+	}
+	return polygon;
+}
+
+/** Times visvalingamReduce() on noisy circles of 1k to 1M points, and the
+ * naive reduction up to max_naive points, checking that both keep the same
+ * points. Returns false on any difference.
+ */
+bool benchmarkVisvalingam(size_t max_naive) {
+	const double REDUCTION = 0.9;
+	bool same = true;
+	for (size_t n = 1000; n <= 1000000; n *= 10) {
+		const Polygon original = noisyCircle(n, 7);
+
+		Polygon fast = original;
+		auto start = std::chrono::steady_clock::now();
+		visvalingamReduce(fast, REDUCTION);
+		const double fast_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << n << " points: heap " << fast_ms << " ms";
+
+		if (n <= max_naive) {
+			Polygon naive = original;
+			start = std::chrono::steady_clock::now();
+			visvalingamReduceNaive(naive, REDUCTION);
+			const double naive_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			bool equal = naive.points.size() == fast.points.size();
+			for (size_t k = 0; equal && k < naive.points.size(); ++k) {
+				equal = naive.points[k].x == fast.points[k].x && naive.points[k].y == fast.points[k].y;
+			}
+			std::cout << ", naive " << naive_ms << " ms" << (equal ? "" : ", DIFFERENT POINTS");
+			same = same && equal;
+		}
+		std::cout << "\n";
+	}
+	return same;
+}
+
+}
+
+int main(int argc, char** argv) {
+	cxxopts::Options options("Bench", "Times the optimized paths of the tools against their reference implementations. Each option runs one benchmark.");
+	options.add_options()
+		("h,help", "Shows full help")
+		("m,media", "Video or image read by the frame benchmarks.", cxxopts::value<std::string>())
+		("f,filter", "Filter file used by the frame benchmarks.", cxxopts::value<std::string>())
+		("contours", "Times tracing the foreground contours of watershed labels against the convertTo/threshold/findContours chain, this many times on a synthetic label image and, with --media and --filter, on the markers of its frames. Errors if the contours differ.", cxxopts::value<int>())
+		("openings", "Times HSV openings of the first frame of --media, as iterated 3x3 erode/dilate and as openRect, for 1, 2, 4, ... up to this count. The mask comes from the first HSV rule of --filter.", cxxopts::value<int>())
+		("pyramid", "Segments frames of --media with --filter at full resolution and through the pyramid of this level, and prints the time of both and how far the pyramid contours deviate.", cxxopts::value<int>())
+		("band", "Half width, in pixels, of the band refined at full resolution by --pyramid.", cxxopts::value<int>()->default_value("4"))
+		("frames", "Frames segmented by --pyramid and --contours.", cxxopts::value<int>()->default_value("100"))
+		("trace", "Times this many stage timers with tracing disabled and enabled against the metrics alone, with an error if disabled tracing is not negligible.", cxxopts::value<size_t>())
+		("visvalingam", "Times Visvalingam on polygons of 1k to 1M points, and the O(n^2) reference up to this many points, with an error if they keep different points.", cxxopts::value<size_t>())
+		("wkt_reader", "Parses every polygon of this WKT file and prints the parse throughput in MB/s.", cxxopts::value<std::string>())
+		("wkt_writer", "Writes a polygon of this many vertices as WKT through iostream and through the buffered writer and prints the time of both.", cxxopts::value<size_t>());
+
+	auto result = options.parse(argc, argv);
+	if (argc == 1 || result.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	if (result.count("openings")) {
+		Mat frame;
+		if (!firstFrame(result, frame)) return 2;
+
+		FilterProgram filter;
+		if (result.count("filter")) {
+			int filter_error = filter.load(result["filter"].as<std::string>());
+			if (filter_error != 0) return filter_error;
+		}
+
+		Mat plane;
+		if (filter.hsvs.empty()) {
+			cvtColor(frame, plane, COLOR_BGR2GRAY);
+			threshold(plane, plane, 127, 255, THRESH_BINARY);
+		} else {
+			cvtColor(frame, plane, COLOR_BGR2HSV);
+			inRange(plane, filter.hsvs[0].low, filter.hsvs[0].high, plane);
+		}
+		if (!benchmarkOpenings(plane, result["openings"].as<int>())) return 7;
+	}
+
+	if (result.count("contours")) {
+		const int repeat = std::max(result["contours"].as<int>(), 1);
+		if (!result.count("media")) {
+			if (!benchmarkContours(nullptr, nullptr, repeat, 0)) return 7;
+		} else {
+			if (!result.count("filter")) {
+				std::cout << "Error. Need to specify --filter.\n";
+				return 3;
+			}
+			FilterProgram filter;
+			int filter_error = filter.load(result["filter"].as<std::string>());
+			if (filter_error != 0) return filter_error;
+
+			VideoCapture media;
+			if (!openMedia(result, media)) return 2;
+			if (!benchmarkContours(&filter, &media, repeat, result["frames"].as<int>())) return 7;
+		}
+	}
+
+	if (result.count("pyramid")) {
+		if (!result.count("filter")) {
+			std::cout << "Error. Need to specify --filter.\n";
+			return 3;
+		}
+		FilterProgram filter;
+		int filter_error = filter.load(result["filter"].as<std::string>());
+		if (filter_error != 0) return filter_error;
+
+		VideoCapture media;
+		if (!openMedia(result, media)) return 2;
+		if (!benchmarkPyramid(filter, media, result["pyramid"].as<int>(), result["band"].as<int>(), result["frames"].as<int>())) return 4;
+	}
+
+	if (result.count("trace")) {
+		if (!benchmarkTracing(result["trace"].as<size_t>())) return 7;
+	}
+
+	if (result.count("visvalingam")) {
+		if (!benchmarkVisvalingam(result["visvalingam"].as<size_t>())) return 7;
+	}
+
+	if (result.count("wkt_reader")) {
+		if (!benchmarkWktReader(result["wkt_reader"].as<std::string>())) return 2;
+	}
+
+	if (result.count("wkt_writer")) {
+		if (!benchmarkWktWriter(result["wkt_writer"].as<size_t>())) return 7;
+	}
+
+	return 0;
+}
@@ -1,23 +1,313 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <cstdint>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <cxxopts.hpp>
+#include "cell_tracker.hpp"
+#include "frame_index.hpp"
+#include "label_contours.hpp"
+#include "metrics.hpp"
 #include "polygon.hpp"
+#include "polygon_stream.hpp"
+#include "trace.hpp"
+#include "wkt_writer.hpp"
 
 using namespace cv;
 
+const int MAX_LABEL = std::numeric_limits<uint16_t>::max();
+
+/** Contours of the cells of one label image, in ascending label order */
+struct FrameCells {
+	std::vector<int> labels;
+	std::vector<std::vector<Point>> contours;
+	std::vector<Rect> boxes;
+};
+
+/** Buffers each thread reuses from image to image */
+struct ExtractBuffers {
+	Mat labels;
+	std::vector<Rect> boxes;
+	std::vector<Point> box_tl, box_br; // Corner tables of labelBoxes
+	std::vector<std::vector<Point>> vertexes;
+	std::vector<signed char> trace;
+};
+
+/** Outer contour of every label of img, background 0 excluded */
+void extractCells(const Mat& img, ExtractBuffers& buffers, FrameCells& cells) {
+	static StageMetrics& labels_stage = metrics().stage("labels");
+	static StageMetrics& contour_stage = metrics().stage("contours");
+
+	//Labels as CV_32SC1, then the box of every label in one pass over a
+	//dense table, so each cell is only traced inside its own box
+	{
+		StageTimer timer(labels_stage);
+		img.convertTo(buffers.labels, CV_32S);
+		labelBoxes(buffers.labels, MAX_LABEL, buffers.boxes, buffers.box_tl, buffers.box_br);
+	}
+
+	StageTimer timer(contour_stage);
+	cells.labels.clear();
+	cells.boxes.clear();
+	size_t n = 0;
+	for (int pixel = 1; pixel <= MAX_LABEL; ++pixel) {
+		const Rect& box = buffers.boxes[pixel];
+		if (box.empty()) continue;
+
+		traceLabelContours(buffers.labels(box), pixel, pixel, buffers.vertexes, CHAIN_APPROX_NONE, box.tl(), buffers.trace);
+		if (cells.contours.size() <= n) cells.contours.resize(n + 1);
+		cells.contours[n++].swap(buffers.vertexes[0]);
+		cells.labels.push_back(pixel);
+		cells.boxes.push_back(box);
+	}
+	cells.contours.resize(n);
+}
+
+/** Label image of a Cell Tracking Challenge sequence, or slice of a stack */
+struct SequenceFrame {
+	uint64_t frame;
+	std::string file;
+	int page; // Page of a multi-page image, -1 to read the file whole
+
+	bool operator<(const SequenceFrame& o) const { return frame < o.frame; }
+};
+
+/** Label images of the sequence in dir, man_seg<t>.tif or mask<t>.tif with
+ * frame number t, sorted by frame. Errors are written to std::cerr.
+ */
+bool listSequence(const std::string& dir, std::vector<SequenceFrame>& frames) {
+	static const char* const PREFIXES[] = {"man_seg", "mask"};
+
+	std::vector<String> files;
+	glob(dir + "/*.tif", files, false);
+	for (const String& f: files) {
+		const std::string name = f.substr(f.find_last_of("/\\") + 1);
+		for (const char* prefix: PREFIXES) {
+			const std::string p(prefix);
+			if (name.compare(0, p.size(), p) != 0) continue;
+
+			//Only the digits of the frame number may follow, so slice images
+			//of 3D ground truth (man_seg_<t>_<z>.tif) are left out
+			const std::string digits = name.substr(p.size(), name.size() - p.size() - 4);
+			if (!digits.empty() && std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+				frames.push_back({std::stoull(digits), f, -1});
+			}
+		}
+	}
+
+	std::sort(frames.begin(), frames.end());
+	for (size_t i = 1; i < frames.size(); ++i) {
+		if (frames[i].frame == frames[i - 1].frame) {
+			std::cerr << "Error. Frame " << frames[i].frame << " appears twice in " << dir << ", as " << frames[i - 1].file
+				<< " and " << frames[i].file << ".\n";
+			return false;
+		}
+	}
+	if (frames.empty()) {
+		std::cerr << "Error. No man_seg*.tif or mask*.tif images in " << dir << ".\n";
+		return false;
+	}
+	return true;
+}
+
+/** Slices of a multi-page label image, such as a 3D TIFF stack, as frames
+ * numbered by page
+ */
+void listStack(const std::string& file, size_t pages, std::vector<SequenceFrame>& frames) {
+	for (size_t k = 0; k < pages; ++k) {
+		frames.push_back({k, file, static_cast<int>(k)});
+	}
+}
+
+/** Reads frame, only its own page for a slice, so a stack is never held in
+ * memory whole
+ */
+Mat readFrame(const SequenceFrame& frame) {
+	if (frame.page < 0) {
+		return imread(frame.file, IMREAD_ANYDEPTH);
+	}
+	std::vector<Mat> pages;
+	if (!imreadmulti(frame.file, pages, frame.page, 1, IMREAD_ANYDEPTH) || pages.empty()) {
+		return Mat();
+	}
+	return pages[0];
+}
+
+/** Extracts the cells of every frame to a chain coded polygon stream and its
+ * frame index, with the frame number of each image and the cell label as
+ * object ID. A cell is then found through the index entry of its frame,
+ * whose records are in ascending label order.
+ *
+ * With link, cells are also linked into tracks as frames are written (see
+ * CellTracker). Every cell is streamed to tracks_file as a line
+ * "<frame> <label> <track> <parent track>", the parent only on the first
+ * frame of a track after a division, and the tracks are written at the end
+ * to res_track_file as Cell Tracking Challenge "<track> <begin> <end> <parent>"
+ * lines.
+ *
+ * Each worker takes the next frame, and reads it itself, until there are
+ * none left, so frames with
+ * many cells do not hold up a fixed share of the sequence. The main thread
+ * writes frames in order, from a window of slots that bounds how far workers
+ * may run ahead of it.
+ */
+int extractSequence(const std::vector<SequenceFrame>& frames, const std::string& output, int threads,
+		bool link, double min_iou, const std::string& tracks_file, const std::string& res_track_file) {
+	static StageMetrics& read_stage = metrics().stage("read");
+	static StageMetrics& write_stage = metrics().stage("write");
+	static StageMetrics& link_stage = metrics().stage("link");
+
+	PolygonStreamWriter stream;
+	FrameIndexWriter index;
+	if (!stream.open(output, true) || !index.open(frameIndexName(output))) {
+		return 3;
+	}
+
+	CellTracker tracker(min_iou);
+	std::vector<CellLink> links;
+	std::ofstream tracks;
+	if (link) {
+		tracks.open(tracks_file, std::ios::out | std::ios::trunc);
+		if (!tracks.is_open()) {
+			std::cerr << "Error. Could not create " << tracks_file << ".\n";
+			return 3;
+		}
+	}
+
+	const size_t n = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	const size_t window = 4 * n;
+	std::vector<FrameCells> slots(window);
+	std::vector<bool> ready(window, false);
+	size_t written = 0;
+	std::mutex mutex; // Guards ready and written
+	std::condition_variable slot_ready, slot_free;
+	std::atomic<size_t> next(0), unreadable(0);
+	metrics().setExpectedFrames(frames.size());
+
+	auto worker = [&](size_t id) {
+		setTraceThreadName("worker " + std::to_string(id));
+		ExtractBuffers buffers;
+		for (size_t i = next++; i < frames.size(); i = next++) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slot_free.wait(lock, [&]() { return i < written + window; });
+			}
+
+			//The slot is this worker's until it is marked as ready
+			TraceFrame trace(frames[i].frame);
+			FrameCells& cells = slots[i % window];
+			Mat img;
+			{
+				StageTimer timer(read_stage);
+				img = readFrame(frames[i]);
+			}
+			if (img.empty()) {
+				++unreadable;
+				cells.labels.clear();
+				cells.contours.clear();
+				cells.boxes.clear();
+			} else {
+				extractCells(img, buffers, cells);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			ready[i % window] = true;
+			slot_ready.notify_one();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t k = 0; k < n; ++k) {
+		workers.emplace_back(worker, k + 1);
+	}
+
+	setTraceThreadName("writer");
+	for (size_t i = 0; i < frames.size(); ++i) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slot_ready.wait(lock, [&]() { return bool(ready[i % window]); });
+		}
+
+		const FrameCells& cells = slots[i % window];
+		{
+			StageTimer timer(write_stage);
+			FrameEntry entry;
+			entry.frame = frames[i].frame;
+			entry.timestamp = std::numeric_limits<double>::quiet_NaN();
+			entry.offset = entry.keyframe = stream.tell();
+			for (size_t k = 0; k < cells.labels.size(); ++k) {
+				stream.write(entry.frame, entry.timestamp, cells.labels[k], cells.contours[k]);
+			}
+			entry.length = stream.tell() - entry.offset;
+			entry.polygons = cells.labels.size();
+			index.add(entry);
+		}
+		if (link) {
+			StageTimer timer(link_stage);
+			tracker.link(frames[i].frame, cells.contours, cells.boxes, links);
+			for (size_t k = 0; k < links.size(); ++k) {
+				tracks << frames[i].frame << " " << cells.labels[k] << " " << links[k].track << " " << links[k].parent << "\n";
+			}
+		}
+		metrics().addFrames();
+		metrics().report(std::cout);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		ready[i % window] = false;
+		++written;
+		slot_free.notify_all();
+	}
+
+	for (std::thread& t: workers) {
+		t.join();
+	}
+
+	if (!stream.flush() || !index.flush()) {
+		std::cerr << "Error. Could not write " << output << ".\n";
+		return 3;
+	}
+	if (link) {
+		std::ofstream res(res_track_file, std::ios::out | std::ios::trunc);
+		for (const CellTrack& t: tracker.tracks()) {
+			res << t.id << " " << t.begin << " " << t.end << " " << t.parent << "\n";
+		}
+		if (!tracks.flush() || !res) {
+			std::cerr << "Error. Could not write the tracks to " << tracks_file << " and " << res_track_file << ".\n";
+			return 3;
+		}
+		std::cout << tracker.tracks().size() << " tracks.\n";
+	}
+	if (unreadable) {
+		std::cerr << "Error. " << unreadable << " of " << frames.size() << " images could not be read, they are indexed as empty frames.\n";
+		return 2;
+	}
+	return 0;
+}
+
 int main(int argc, char* argv[]) {
 	cxxopts::Options options("Cell extractor", "Extracts information from cell images from the cell tracking challenge. Call with -h or --help to see full help.");
 	options.add_options()
 		("h,help", "Shows full help")
-		("i", "Mandatory. Grayscale pre segmented image to extract polygons.", cxxopts::value<std::string>())
-		("o", "Mandatory. Output folder. WKT's will be output to this folder.", cxxopts::value<std::string>());
+		("i", "Mandatory without --sequence. Grayscale pre segmented image to extract polygons. A multi-page image, such as a 3D TIFF stack, is extracted a slice at a time in parallel as --sequence does, with the slice number as frame.", cxxopts::value<std::string>())
+		("o", "Mandatory. Output folder. WKT's will be output to this folder.", cxxopts::value<std::string>())
+		("metrics", "Writes the timings of every stage to this JSON file at the end.", cxxopts::value<std::string>())
+		("chain", "Writes all cells to a single chain coded polygon stream, cells.mply in the output folder, with the cell label as object ID.")
+		("sequence", "Extracts every man_seg<t>.tif or mask<t>.tif label image of this folder, a Cell Tracking Challenge sequence, to a single chain coded polygon stream, cells.mply in the output folder, with frame t and the cell label as object ID, and its frame index cells.mply.idx.", cxxopts::value<std::string>())
+		("link", "With --sequence or a stack, links cells across consecutive frames into tracks, streamed as \"<frame> <label> <track> <parent track>\" lines to tracks.txt in the output folder, and writes the tracks with their division parents to res_track.txt as in the Cell Tracking Challenge.")
+		("min_iou", "Lowest IoU of a cell with a cell of the previous frame for --link to match them.", cxxopts::value<double>()->default_value("0.2"))
+		("t,threads", "Number of extraction threads with --sequence or a stack. 0 uses one per hardware thread.", cxxopts::value<int>()->default_value("0"))
+		("trace", "Writes a Chrome trace of every stage and frame to this JSON file at the end.", cxxopts::value<std::string>());
 
 	if (argc==1) {
 		std::cout << options.help() << std::endl;
@@ -31,59 +321,73 @@ int main(int argc, char* argv[]) {
 		return 0;
 	}
 
-	if (!result.count("i") && !result.count("o")) {
-		std::cout << "Error. Need to specify input image and output folder.\n";
+	if ((!result.count("i") && !result.count("sequence")) || !result.count("o")) {
+		std::cout << "Error. Need to specify input image or sequence and output folder.\n";
 		return 1;
 	}
+	enableTracing(result.count("trace") > 0);
 
-	Mat img = imread(result["i"].as<std::string>(), IMREAD_ANYDEPTH);
-
-	std::vector<uint16_t> done;
-
-	for (int i = 0; i < img.rows; ++i) { 
-		for (int j = 0; j < img.cols; ++j) {
-			uint16_t pixel = img.at<uint16_t>(i, j);
-			if (pixel != 0) {
-				bool skip = false;
-				for (uint16_t d: done)
-					if (d == pixel) {
-						skip = true;
-						break;
-					}
-
-				if (skip) break;
-
-				Mat filtered = (img == pixel);
-
-				std::vector<std::vector<Point>> vertexes;
-
-				findContours(filtered, vertexes, RETR_EXTERNAL, CHAIN_APPROX_NONE);
-
-				std::fstream fs(result["o"].as<std::string>() + std::to_string(pixel) + ".wkt",
-					std::fstream::out | std::fstream::trunc);
-				fs << "POLYGON((";
-
-				bool first = true;
-				Point p1;
-				for (Point p: vertexes[0]) {
-					if (!first) {
-						fs << ",";
-					}
-					else
-					{
-						p1 = p;
-						first = false;
-					}
-					fs << p.x << " " << p.y;					
-				}
-				if (!first) {
-					fs << ",";
-				}
-				fs << p1.x << " " << p1.y << "))\n";
-				fs.close();
-
-				done.push_back(pixel);
+	const size_t pages = result.count("i") ? imcount(result["i"].as<std::string>(), IMREAD_ANYDEPTH) : 0;
+
+	int ret = 0;
+	if (result.count("sequence") || pages > 1) {
+		std::vector<SequenceFrame> frames;
+		if (pages > 1) {
+			listStack(result["i"].as<std::string>(), pages, frames);
+		} else if (!listSequence(result["sequence"].as<std::string>(), frames)) {
+			return 2;
+		}
+		const std::string out = result["o"].as<std::string>();
+		ret = extractSequence(frames, out + "cells.mply", result["threads"].as<int>(), result["link"].as<bool>(),
+				result["min_iou"].as<double>(), out + "tracks.txt", out + "res_track.txt");
+	} else {
+		static StageMetrics& read_stage = metrics().stage("read");
+		static StageMetrics& write_stage = metrics().stage("write");
+
+		Mat img;
+		{
+			StageTimer timer(read_stage);
+			img = imread(result["i"].as<std::string>(), IMREAD_ANYDEPTH);
+		}
+		if (img.empty()) {
+			std::cerr << "Error. Could not read " << result["i"].as<std::string>() << " as an image.\n";
+			return 2;
+		}
+
+		PolygonStreamWriter stream;
+		if (result["chain"].as<bool>() && !stream.open(result["o"].as<std::string>() + "cells.mply", true)) {
+			return 3;
+		}
+
+		ExtractBuffers buffers;
+		FrameCells cells;
+		extractCells(img, buffers, cells);
+
+		StageTimer timer(write_stage);
+		for (size_t k = 0; k < cells.labels.size(); ++k) {
+			if (stream.isOpen()) {
+				stream.write(0, std::numeric_limits<double>::quiet_NaN(), cells.labels[k], cells.contours[k]);
+				continue;
 			}
+
+			std::fstream fs(result["o"].as<std::string>() + std::to_string(cells.labels[k]) + ".wkt",
+				std::fstream::out | std::fstream::trunc);
+			{
+				WktWriter wkt(fs, WKT_COMPACT);
+				wkt.polygon(cells.contours[k]);
+				wkt.text("\n");
+			}
+			fs.close();
 		}
+		metrics().addFrames();
+	}
+
+	metrics().report(std::cout, true);
+	if (result.count("metrics") && !metrics().writeJson(result["metrics"].as<std::string>(), "cell_extraction")) {
+		return 3;
+	}
+	if (result.count("trace") && !writeTrace(result["trace"].as<std::string>())) {
+		return 3;
 	}
+	return ret;
 }
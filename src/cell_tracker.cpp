@@ -0,0 +1,132 @@
+#include "cell_tracker.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "reusable_buffer.hpp"
+
+using namespace cv;
+
+CellTracker::CellTracker(double min_iou) : min_iou(min_iou) {
+}
+
+void CellTracker::buildGrid() {
+	//Buckets about as large as the average cell, so each cell reaches a few
+	//of them and each bucket holds a few cells
+	int extent_x = 0, extent_y = 0;
+	int64_t sides = 0;
+	for (const Rect& box: prev_boxes) {
+		extent_x = std::max(extent_x, box.br().x);
+		extent_y = std::max(extent_y, box.br().y);
+		sides += std::max(box.width, box.height);
+	}
+	grid_size = std::max<int>(8, prev_boxes.empty() ? 0 : sides / prev_boxes.size());
+	grid_cols = extent_x / grid_size + 1;
+	grid_rows = extent_y / grid_size + 1;
+
+	//Counting sort of the cells by bucket
+	bucket_start.assign(grid_cols * grid_rows + 1, 0);
+	for (const Rect& box: prev_boxes) {
+		for (int y = box.y / grid_size; y <= (box.br().y - 1) / grid_size; ++y) {
+			for (int x = box.x / grid_size; x <= (box.br().x - 1) / grid_size; ++x) {
+				++bucket_start[y * grid_cols + x + 1];
+			}
+		}
+	}
+	for (size_t k = 1; k < bucket_start.size(); ++k) {
+		bucket_start[k] += bucket_start[k - 1];
+	}
+	bucket_cells.resize(bucket_start.back());
+	std::vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+	for (size_t c = 0; c < prev_boxes.size(); ++c) {
+		const Rect& box = prev_boxes[c];
+		for (int y = box.y / grid_size; y <= (box.br().y - 1) / grid_size; ++y) {
+			for (int x = box.x / grid_size; x <= (box.br().x - 1) / grid_size; ++x) {
+				bucket_cells[fill[y * grid_cols + x]++] = c;
+			}
+		}
+	}
+}
+
+double CellTracker::iou(const std::vector<Point>& a, const Rect& box_a, const std::vector<Point>& b, const Rect& box_b) {
+	//Both polygons filled over the union of their boxes, contour pixels
+	//included, which gives back the pixels of the labels they were traced from
+	const Rect u = box_a | box_b;
+	Mat fill_a = reuseBuffer(mask_a, u.size(), CV_8UC1);
+	Mat fill_b = reuseBuffer(mask_b, u.size(), CV_8UC1);
+	fill_a.setTo(0);
+	fill_b.setTo(0);
+	const Point* pts[] = {a.data(), b.data()};
+	const int npts[] = {static_cast<int>(a.size()), static_cast<int>(b.size())};
+	fillPoly(fill_a, &pts[0], &npts[0], 1, Scalar(1), LINE_8, 0, -u.tl());
+	fillPoly(fill_b, &pts[1], &npts[1], 1, Scalar(1), LINE_8, 0, -u.tl());
+
+	int64_t inter = 0, uni = 0;
+	for (int y = 0; y < u.height; ++y) {
+		const unsigned char* row_a = fill_a.ptr<unsigned char>(y);
+		const unsigned char* row_b = fill_b.ptr<unsigned char>(y);
+		for (int x = 0; x < u.width; ++x) {
+			inter += row_a[x] & row_b[x];
+			uni += row_a[x] | row_b[x];
+		}
+	}
+	return uni ? static_cast<double>(inter) / uni : 0;
+}
+
+void CellTracker::link(uint64_t frame, const std::vector<std::vector<Point>>& contours,
+		const std::vector<Rect>& boxes, std::vector<CellLink>& links) {
+	CV_Assert(contours.size() == boxes.size());
+	buildGrid();
+
+	//Best previous cell of each cell, through the buckets its box reaches
+	best.assign(contours.size(), -1);
+	stamp.assign(prev_boxes.size(), -1);
+	for (size_t c = 0; c < contours.size(); ++c) {
+		const Rect& box = boxes[c];
+		double best_iou = min_iou;
+		const int x0 = std::min(box.x / grid_size, grid_cols - 1), x1 = std::min((box.br().x - 1) / grid_size, grid_cols - 1);
+		const int y0 = std::min(box.y / grid_size, grid_rows - 1), y1 = std::min((box.br().y - 1) / grid_size, grid_rows - 1);
+		for (int y = y0; y <= y1; ++y) {
+			for (int x = x0; x <= x1; ++x) {
+				const int bucket = y * grid_cols + x;
+				for (int k = bucket_start[bucket]; k < bucket_start[bucket + 1]; ++k) {
+					const int p = bucket_cells[k];
+					if (stamp[p] == static_cast<int>(c)) continue;
+					stamp[p] = c;
+					if ((box & prev_boxes[p]).empty()) continue;
+
+					const double overlap = iou(contours[c], box, prev_contours[p], prev_boxes[p]);
+					if (overlap >= best_iou) {
+						best_iou = overlap;
+						best[c] = p;
+					}
+				}
+			}
+		}
+	}
+
+	matches.assign(prev_boxes.size(), 0);
+	for (int p: best) {
+		if (p >= 0) ++matches[p];
+	}
+
+	links.resize(contours.size());
+	std::vector<uint32_t> tracks(contours.size());
+	for (size_t c = 0; c < contours.size(); ++c) {
+		const int p = best[c];
+		if (p >= 0 && matches[p] == 1) {
+			links[c] = {prev_tracks[p], 0};
+			all_tracks[prev_tracks[p] - 1].end = frame;
+		} else {
+			const uint32_t parent = p >= 0 ? prev_tracks[p] : 0;
+			all_tracks.push_back({static_cast<uint32_t>(all_tracks.size() + 1), frame, frame, parent});
+			links[c] = {all_tracks.back().id, parent};
+		}
+		tracks[c] = links[c].track;
+	}
+
+	prev_contours = contours;
+	prev_boxes = boxes;
+	prev_tracks.swap(tracks);
+}
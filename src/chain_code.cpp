@@ -0,0 +1,87 @@
+#include "chain_code.hpp"
+
+using namespace cv;
+
+namespace {
+
+const int DX[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+const int DY[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+
+//Direction of (dx + 1, dy + 1)
+const int DIRECTION[3][3] = {
+	{3, 4, 5},
+	{2, -1, 6},
+	{1, 0, 7}
+};
+
+}
+
+int chainDirection(Point step) {
+	if (step.x < -1 || step.x > 1 || step.y < -1 || step.y > 1) return -1;
+	return DIRECTION[step.x + 1][step.y + 1];
+}
+
+bool isChain(const std::vector<Point>& points) {
+	for (size_t i = 1; i < points.size(); ++i) {
+		if (chainDirection(points[i] - points[i - 1]) < 0) return false;
+	}
+	return true;
+}
+
+size_t chainBytes(uint32_t count) {
+	return count < 2 ? 0 : (size_t(count - 1) * 3 + 7) / 8;
+}
+
+void encodeChain(const std::vector<Point>& points, std::vector<unsigned char>& buf) {
+	uint32_t bits = 0;
+	int used = 0;
+	for (size_t i = 1; i < points.size(); ++i) {
+		bits |= uint32_t(chainDirection(points[i] - points[i - 1])) << used;
+		used += 3;
+		if (used >= 8) {
+			buf.push_back(bits & 0xff);
+			bits >>= 8;
+			used -= 8;
+		}
+	}
+	if (used > 0) {
+		buf.push_back(bits & 0xff);
+	}
+}
+
+bool decodeChain(const unsigned char*& p, const unsigned char* end, Point start, uint32_t count,
+		std::vector<Point>& points) {
+	const size_t bytes = chainBytes(count);
+	if (size_t(end - p) < bytes) return false;
+	points.resize(count);
+	if (count == 0) return true;
+
+	points[0] = start;
+	int x = start.x, y = start.y;
+	uint32_t i = 1;
+
+	//Three bytes hold exactly eight codes
+	const unsigned char* q = p;
+	for (; count - i >= 8; i += 8, q += 3) {
+		uint32_t bits = uint32_t(q[0]) | (uint32_t(q[1]) << 8) | (uint32_t(q[2]) << 16);
+		for (int k = 0; k < 8; ++k, bits >>= 3) {
+			x += DX[bits & 7];
+			y += DY[bits & 7];
+			points[i + k] = Point(x, y);
+		}
+	}
+
+	//Remaining codes, fewer than eight
+	uint32_t bits = 0;
+	for (const unsigned char* r = q; r < p + bytes; ++r) {
+		bits |= uint32_t(*r) << (8 * (r - q));
+	}
+	for (; i < count; ++i, bits >>= 3) {
+		x += DX[bits & 7];
+		y += DY[bits & 7];
+		points[i] = Point(x, y);
+	}
+
+	p += bytes;
+	return true;
+}
@@ -1,7 +1,5 @@
 #include <cmath>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
@@ -9,8 +7,7 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
-#include "polygon.hpp"
-#include "simplifier.hpp"
+#include "wkt_reader.hpp"
 
 #include "cxxopts.hpp"
 
@@ -45,12 +42,16 @@ int main(int argc, char *argv[]) {
 
 	Mat image = imread(result["i"].as<std::string>());
 
-	std::fstream fs(result["p"].as<std::string>());
-	Polygon p(fs, Polygon::FileType::FILE_WKT);
+	WktReader reader;
+	WktPolygon p;
+	if (!reader.open(result["p"].as<std::string>()) || !reader.next(p)) {
+		std::cout << "Error. Could not read a WKT polygon from " << result["p"].as<std::string>() << ".\n";
+		return 2;
+	}
 
 	std::vector<std::vector<Point>> pol;
 	pol.emplace_back();
-	for (SimplePoint pt: p.points)
+	for (Point2d pt: p.points)
 		pol[0].emplace_back(pt.x, pt.y);
 
 	drawContours(image, pol, 0, Scalar(0, 165, 255), 5);
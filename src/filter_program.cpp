@@ -0,0 +1,455 @@
+#include "filter_program.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "morphology.hpp"
+#include "reusable_buffer.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Bit mask image type used for each lookup table type */
+template <typename T> int bitsType();
+template <> int bitsType<uint8_t>() { return CV_8UC1; }
+template <> int bitsType<uint16_t>() { return CV_16UC1; }
+template <> int bitsType<uint32_t>() { return CV_32SC1; }
+
+/** Fills lut with one bit per HSV rule for each BGR colour (index b<<16 | g<<8 | r).
+ * Colours are classified 65536 at a time with the same cvtColor/inRange calls
+ * used on frames, so the table is exact.
+ */
+template <typename T>
+void fillLut(const std::vector<HSVRule>& hsvs, std::vector<T>& lut) {
+	lut.assign(1 << 24, 0);
+
+	Mat bgr(256, 256, CV_8UC3), hsv_img, in_range;
+	for (int b = 0; b < 256; ++b) {
+		for (int g = 0; g < 256; ++g) {
+			Vec3b* row = bgr.ptr<Vec3b>(g);
+			for (int r = 0; r < 256; ++r) {
+				row[r][0] = b;
+				row[r][1] = g;
+				row[r][2] = r;
+			}
+		}
+		cvtColor(bgr, hsv_img, COLOR_BGR2HSV);
+
+		T* out = &lut[b << 16];
+		for (size_t i = 0; i < hsvs.size(); ++i) {
+			inRange(hsv_img, hsvs[i].low, hsvs[i].high, in_range);
+			const T bit = T(1) << i;
+			for (int g = 0; g < 256; ++g) {
+				const unsigned char* in = in_range.ptr<unsigned char>(g);
+				for (int r = 0; r < 256; ++r) {
+					if (in[r]) out[(g << 8) | r] |= bit;
+				}
+			}
+		}
+	}
+}
+
+}
+
+void FilterProgram::buildLut() {
+	std::shared_ptr<Luts> tables = std::make_shared<Luts>();
+	luts = tables;
+
+	//Composition tables, computed with the same add/addWeighted calls as the reference path
+	Mat ramp(1, 256, CV_8UC1), full(1, 256, CV_8UC1, Scalar(255)), out;
+	for (int v = 0; v < 256; ++v) {
+		ramp.at<unsigned char>(0, v) = v;
+	}
+	add(ramp, full, out, noArray(), CV_8UC1);
+	for (int v = 0; v < 256; ++v) {
+		fg_table[v] = out.at<unsigned char>(0, v);
+	}
+	addWeighted(ramp, 1, full, 0.5, 0, out, CV_8UC1);
+	for (int v = 0; v < 256; ++v) {
+		bg_table[v] = out.at<unsigned char>(0, v);
+	}
+
+	if (hsvs.empty()) {
+		return;
+	} else if (hsvs.size() <= 8) {
+		fillLut(hsvs, tables->lut8);
+	} else if (hsvs.size() <= 16) {
+		fillLut(hsvs, tables->lut16);
+	} else if (hsvs.size() <= 32) {
+		fillLut(hsvs, tables->lut32);
+	} //More rules than bits: execute() falls back to the reference path
+}
+
+int FilterProgram::load(const std::string& filename) {
+	std::fstream filter(filename, std::fstream::in);
+	if (!filter.is_open()) {
+		std::cerr << "Error. Could not open filter file " << filename << "\n";
+		return 1;
+	}
+
+	positionals.clear();
+	rectangles.clear();
+	hsvs.clear();
+	rules.clear();
+	steps.clear();
+	layers.clear();
+
+	std::string line;
+	size_t line_no = 0;
+	int max_object = 1;
+	while (std::getline(filter, line)) {
+		++line_no;
+		if (line.size() == 0 || line[0] == '#') {
+			continue;
+		}
+
+		std::stringstream ss(line);
+		std::string roi, type;
+		ss >> roi >> type;
+
+		//ROI is 'b', 'f' (object 1) or 'f' followed by an object ID
+		bool fg;
+		int object = 0;
+		if (roi == "b") {
+			fg = false;
+		} else if (roi.size() > 0 && roi[0] == 'f') {
+			fg = true;
+			object = 1;
+			if (roi.size() > 1) {
+				std::stringstream id(roi.substr(1));
+				if (!(id >> object) || !id.eof() || object < 1 || object > MAX_OBJECTS) {
+					std::cerr << "Error. Object ID must be between 1 and " << MAX_OBJECTS << ". Line " << line_no << ": " << line << "\n";
+					return 2;
+				}
+			}
+			max_object = std::max(max_object, object);
+		} else {
+			std::cerr << "Error. First char of filter line is not 'f' or 'b'. Line " << line_no << ": " << line << "\n";
+			return 2;
+		}
+
+		if (type.size() != 1) {
+			std::cerr << "Error. Unknown filter. Line " << line_no << ": " << line << "\n";
+			return 3;
+		}
+
+		if (type[0] == 'p') { //Positional mask
+			PositionalRule r;
+			r.fg = fg;
+			r.object = object;
+			ss >> r.p.x >> r.p.y;
+			if (ss.fail()) {
+				std::cerr << "Error. Positional filter needs 2 parameters. Line " << line_no << ": " << line << "\n";
+				return 4;
+			}
+			rules.push_back({RuleType::POSITIONAL, positionals.size()});
+			positionals.push_back(r);
+		} else if (type[0] == 'r') { //Rectangle
+			RectangleRule r;
+			r.fg = fg;
+			r.object = object;
+			ss >> r.p1.x >> r.p1.y >> r.p2.x >> r.p2.y;
+			if (ss.fail()) {
+				std::cerr << "Error. Rectangle filter needs 4 parameters. Line " << line_no << ": " << line << "\n";
+				return 4;
+			}
+			rules.push_back({RuleType::RECTANGLE, rectangles.size()});
+			rectangles.push_back(r);
+		} else if (type[0] == 'h') { //HSV mask filter
+			HSVRule r;
+			r.fg = fg;
+			r.object = object;
+			float hlow, slow, vlow;
+			float hhigh, shigh, vhigh;
+			ss >> r.openings >> hlow >> slow >> vlow >> hhigh >> shigh >> vhigh;
+			if (ss.fail()) {
+				std::cerr << "Error. HSV filter needs 7 parameters. Line " << line_no << ": " << line << "\n";
+				return 4;
+			}
+			r.low = Scalar(hlow, slow, vlow);
+			r.high = Scalar(hhigh, shigh, vhigh);
+			rules.push_back({RuleType::HSV, hsvs.size()});
+			hsvs.push_back(r);
+		} else {
+			std::cerr << "Error. Unknown filter. Line " << line_no << ": " << line << "\n";
+			return 3;
+		}
+	}
+
+	object_count = max_object;
+	buildLut();
+	return 0;
+}
+
+Size FilterProgram::pyramidSize(Size frame_size, int level) {
+	for (int l = 0; l < level; ++l) {
+		frame_size = Size((frame_size.width + 1) / 2, (frame_size.height + 1) / 2);
+	}
+	return frame_size;
+}
+
+bool FilterProgram::rasterize(const Size& frame_size, int level) {
+	size = frame_size;
+	steps.clear();
+	layers.clear();
+	pyramid_level = 0;
+	coarse_program.reset();
+
+	if (level > 0) {
+		//Same rules on the reduced frame. Openings are scaled as well, as each
+		//one removes a pixel of the reduced frame
+		std::shared_ptr<FilterProgram> reduced = std::make_shared<FilterProgram>(*this);
+		for (PositionalRule& r: reduced->positionals) {
+			r.p = Point(r.p.x >> level, r.p.y >> level);
+		}
+		for (RectangleRule& r: reduced->rectangles) {
+			r.p1 = Point(r.p1.x >> level, r.p1.y >> level);
+			r.p2 = Point(r.p2.x >> level, r.p2.y >> level);
+		}
+		for (HSVRule& r: reduced->hsvs) {
+			r.openings = (r.openings + (1 << level) / 2) >> level;
+		}
+		if (!reduced->rasterize(pyramidSize(frame_size, level))) {
+			return false;
+		}
+		pyramid_level = level;
+		coarse_program = reduced;
+	}
+
+	//Groups consecutive fixed rules in a single layer, so that the order of
+	//the file is kept when HSV rules are interleaved with them
+	for (const Rule& rule: rules) {
+		if (rule.type == RuleType::HSV) {
+			steps.push_back({false, rule.index});
+			continue;
+		}
+
+		if (steps.empty() || !steps.back().fixed) {
+			Layer l;
+			l.values = Mat::zeros(size, CV_8UC1);
+			l.coverage = Mat::zeros(size, CV_8UC1);
+			l.objects = Mat::zeros(size, CV_8UC1);
+			steps.push_back({true, layers.size()});
+			layers.push_back(l);
+		}
+		Layer& l = layers.back();
+
+		if (rule.type == RuleType::POSITIONAL) {
+			const PositionalRule& r = positionals[rule.index];
+			if (r.p.x < 0 || r.p.y < 0 || r.p.x >= size.width || r.p.y >= size.height) {
+				std::cerr << "Error. Positional filter (" << r.p.x << "," << r.p.y << ") is outside of the "
+					<< size.width << "x" << size.height << " frame.\n";
+				return false;
+			}
+			l.values.at<unsigned char>(r.p) = (r.fg ? 255 : 128);
+			l.coverage.at<unsigned char>(r.p) = 255;
+			l.objects.at<unsigned char>(r.p) = r.object;
+		} else {
+			const RectangleRule& r = rectangles[rule.index];
+			rectangle(l.values, r.p1, r.p2, (r.fg ? 255 : 128), -1);
+			rectangle(l.coverage, r.p1, r.p2, 255, -1);
+			rectangle(l.objects, r.p1, r.p2, r.object, -1);
+		}
+	}
+	return true;
+}
+
+void FilterProgram::executeReference(const Mat& src, Mat& mask) const {
+	executeReference(src, Rect(Point(0, 0), size), mask);
+}
+
+void FilterProgram::executeReference(const Mat& full_src, const Rect& roi, Mat& mask) const {
+	CV_Assert(full_src.size() == size);
+	const Mat src = full_src(roi);
+
+	Mat mask8u = Mat::zeros(roi.size(), CV_8UC1);
+	Mat objects = Mat::zeros(roi.size(), CV_8UC1); // Last foreground object marked on each pixel
+	Mat hsv_img, temp_bin;
+
+	for (size_t i = 0; i < steps.size(); ++i) {
+		const Step& s = steps[i];
+		if (s.fixed) {
+			if (i == 0) { //Nothing to overwrite yet
+				layers[s.index].values(roi).copyTo(mask8u);
+				layers[s.index].objects(roi).copyTo(objects);
+			} else {
+				layers[s.index].values(roi).copyTo(mask8u, layers[s.index].coverage(roi));
+				layers[s.index].objects(roi).copyTo(objects, layers[s.index].coverage(roi));
+			}
+			continue;
+		}
+
+		const HSVRule& r = hsvs[s.index];
+		if (hsv_img.empty()) {
+			cvtColor(src, hsv_img, COLOR_BGR2HSV); // Converts to HSV, once per frame
+		}
+		inRange(hsv_img, r.low, r.high, temp_bin);
+
+		if (r.openings != 0) {
+			erode(temp_bin, temp_bin, Mat(), Point(-1, 1), r.openings);
+			dilate(temp_bin, temp_bin, Mat(), Point(-1, 1), r.openings);
+		}
+
+		if (r.fg) {
+			add(mask8u, temp_bin, mask8u, noArray(), CV_8UC1);
+			objects.setTo(Scalar(r.object), temp_bin);
+		} else {
+			addWeighted(mask8u, 1, temp_bin, 0.5, 0, mask8u, CV_8UC1);
+		}
+	}
+
+	//Foreground pixels get the label of their object
+	mask.create(roi.size(), CV_32SC1);
+	for (int y = 0; y < roi.height; ++y) {
+		const unsigned char* v = mask8u.ptr<unsigned char>(y);
+		const unsigned char* o = objects.ptr<unsigned char>(y);
+		int* out = mask.ptr<int>(y);
+		for (int x = 0; x < roi.width; ++x) {
+			out[x] = v[x] > FG_THRESHOLD ? objectLabel(o[x] ? o[x] : 1) : v[x];
+		}
+	}
+}
+
+void FilterProgram::execute(const Mat& src, Mat& mask) const {
+	execute(src, Rect(Point(0, 0), size), mask);
+}
+
+void FilterProgram::execute(const Mat& src, const Rect& roi, Mat& mask) const {
+	Scratch scratch;
+	execute(src, roi, mask, scratch);
+}
+
+void FilterProgram::execute(const Mat& src, const Rect& roi, Mat& mask, Scratch& scratch) const {
+	if (src.type() != CV_8UC3 || hsvs.size() > 32) {
+		executeReference(src, roi, mask);
+	} else if (hsvs.size() <= 8) {
+		executeLut(src, roi, luts->lut8, mask, scratch);
+	} else if (hsvs.size() <= 16) {
+		executeLut(src, roi, luts->lut16, mask, scratch);
+	} else {
+		executeLut(src, roi, luts->lut32, mask, scratch);
+	}
+}
+
+void FilterProgram::reserve(Scratch& scratch) const {
+	int openings = 0;
+	for (const HSVRule& r: hsvs) {
+		openings = std::max(openings, int(r.openings));
+	}
+	if (openings > 0) {
+		const int type = hsvs.size() <= 8 ? bitsType<uint8_t>() : hsvs.size() <= 16 ? bitsType<uint16_t>() : bitsType<uint32_t>();
+		reuseBuffer(scratch.bits, size, type);
+		reuseBuffer(scratch.plane, size, CV_8UC1);
+	}
+	if (openings >= RUNNING_MORPHOLOGY_MIN_ITERATIONS) {
+		//Largest buffers of the running min/max, see morphology.cpp
+		MorphologyBuffers& m = scratch.morphology;
+		reuseBuffer(m.rows, size, CV_8UC1);
+		reuseBuffer(m.g, Size(size.width, size.height + 2 * openings), CV_8UC1);
+		reuseBuffer(m.h, Size(size.width, size.height + 2 * openings), CV_8UC1);
+		m.row_p.reserve(size.width + 2 * openings);
+		m.row_g.reserve(size.width + 2 * openings);
+		m.row_h.reserve(size.width + 2 * openings);
+		m.neutral.reserve(size.width);
+	}
+	scratch.values.reserve(layers.size());
+	scratch.coverage.reserve(layers.size());
+	scratch.objects.reserve(layers.size());
+}
+
+template <typename T>
+void FilterProgram::executeLut(const Mat& full_src, const Rect& roi, const std::vector<T>& lut, Mat& mask, Scratch& scratch) const {
+	CV_Assert(full_src.size() == size);
+	const Mat src = full_src(roi);
+	const Size area = roi.size();
+
+	//Rules with openings need their own plane for erode/dilate, so in that
+	//case the bits are materialized first. Otherwise everything is done in
+	//the single pass below, straight from the BGR frame.
+	bool has_openings = false;
+	for (const HSVRule& r: hsvs) {
+		has_openings = has_openings || r.openings != 0;
+	}
+
+	Mat bits;
+	if (has_openings) {
+		bits = reuseBuffer(scratch.bits, area, bitsType<T>());
+		for (int y = 0; y < area.height; ++y) {
+			const unsigned char* in = src.ptr<unsigned char>(y);
+			T* out = bits.ptr<T>(y);
+			for (int x = 0; x < area.width; ++x, in += 3) {
+				out[x] = lut[(in[0] << 16) | (in[1] << 8) | in[2]];
+			}
+		}
+
+		Mat plane = reuseBuffer(scratch.plane, area, CV_8UC1);
+		for (size_t i = 0; i < hsvs.size(); ++i) {
+			if (hsvs[i].openings == 0) continue;
+			const T bit = T(1) << i;
+			for (int y = 0; y < area.height; ++y) {
+				const T* b = bits.ptr<T>(y);
+				unsigned char* p = plane.ptr<unsigned char>(y);
+				for (int x = 0; x < area.width; ++x) {
+					p[x] = (b[x] & bit) ? 255 : 0;
+				}
+			}
+
+			openRect(plane, plane, hsvs[i].openings, scratch.morphology);
+
+			for (int y = 0; y < area.height; ++y) {
+				T* b = bits.ptr<T>(y);
+				const unsigned char* p = plane.ptr<unsigned char>(y);
+				for (int x = 0; x < area.width; ++x) {
+					b[x] = p[x] ? (b[x] | bit) : (b[x] & ~bit);
+				}
+			}
+		}
+	}
+
+	//Composition, in file order, of fixed layers and matching HSV rules
+	mask.create(area, CV_32SC1);
+	std::vector<const unsigned char*>& values = scratch.values;
+	std::vector<const unsigned char*>& coverage = scratch.coverage;
+	std::vector<const unsigned char*>& objects = scratch.objects;
+	values.resize(layers.size());
+	coverage.resize(layers.size());
+	objects.resize(layers.size());
+	for (int y = 0; y < area.height; ++y) {
+		for (size_t l = 0; l < layers.size(); ++l) {
+			values[l] = layers[l].values.ptr<unsigned char>(roi.y + y) + roi.x;
+			coverage[l] = layers[l].coverage.ptr<unsigned char>(roi.y + y) + roi.x;
+			objects[l] = layers[l].objects.ptr<unsigned char>(roi.y + y) + roi.x;
+		}
+		const unsigned char* in = src.ptr<unsigned char>(y);
+		const T* b = has_openings ? bits.ptr<T>(y) : nullptr;
+		int* out = mask.ptr<int>(y);
+
+		for (int x = 0; x < area.width; ++x, in += 3) {
+			const T matches = b ? b[x] : (lut.empty() ? 0 : lut[(in[0] << 16) | (in[1] << 8) | in[2]]);
+			unsigned char v = 0;
+			int o = 0;
+			for (const Step& s: steps) {
+				if (s.fixed) {
+					if (coverage[s.index][x]) {
+						v = values[s.index][x];
+						o = objects[s.index][x];
+					}
+				} else if (matches & (T(1) << s.index)) {
+					const HSVRule& r = hsvs[s.index];
+					if (r.fg) {
+						v = fg_table[v];
+						o = r.object;
+					} else {
+						v = bg_table[v];
+					}
+				}
+			}
+			out[x] = v > FG_THRESHOLD ? objectLabel(o ? o : 1) : v;
+		}
+	}
+}
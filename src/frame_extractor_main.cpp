@@ -6,16 +6,43 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
 
+#include "metrics.hpp"
+
 using namespace cv;
 
 void save(const Mat& frame, bool bw = false, double resize_factor = 1.0, std::string fname = "");
 
 const char* WHNDL = "Video";
 
+std::string metrics_file; // Written at exit, if given
+
+/** Reads the next frame, timed as the decode stage */
+bool readFrame(VideoCapture& vid, Mat& frame)
+{
+    static StageMetrics& stage = metrics().stage("decode");
+    StageTimer timer(stage);
+    return vid.read(frame);
+}
+
+int finish(int code)
+{
+    metrics().report(std::cout, true);
+    if (!metrics_file.empty() && !metrics().writeJson(metrics_file, "frame_extractor")) {
+        return 3;
+    }
+    return code;
+}
+
 int main(int argc, char* argv[])
 {
+    if (argc >= 4 && std::string(argv[argc - 2]) == "--metrics") {
+        metrics_file = argv[argc - 1];
+        argc -= 2;
+    }
+
     if (argc != 2 && argc != 3 && argc != 4) {
-        std::cout << "Error! Usage: ./frame_extractor <vid> or ./frame_extractor <vid> <n_frames>\n";
+        std::cout << "Error! Usage: ./frame_extractor <vid> or ./frame_extractor <vid> <n_frames>\n"
+                  << "Add --metrics <file> at the end to write stage timings as JSON.\n";
         exit(1);
     }
 
@@ -24,9 +51,9 @@ int main(int argc, char* argv[])
 			double frame = std::stod(argv[2]);
 			vid.set(CAP_PROP_POS_FRAMES, frame);
 			Mat cur_frame;
-			vid >> cur_frame;
+			readFrame(vid, cur_frame);
 			save(cur_frame);
-			return 0;
+			return finish(0);
 		}
     VideoCapture vid(argv[1]);
     double max_frames = vid.get(CAP_PROP_FRAME_COUNT);
@@ -52,7 +79,7 @@ int main(int argc, char* argv[])
         while ((c = waitKey())) {
             switch (c) {
             case 'q':
-                return 1;
+                return finish(1);
             case 'n':
                 cur_frame += 10;
                 break;
@@ -113,9 +140,12 @@ int main(int argc, char* argv[])
         int cur_frame = 0;
         std::string fname;
         int i = 0;
+        metrics().setExpectedFrames(max_frames);
 
         while (cur_frame < max_frames) {
-            vid >> frame;
+            readFrame(vid, frame);
+            metrics().addFrames();
+            metrics().report(std::cout);
 
             if ((cur_frame % each) == 0) {
                 fname = argv[1];
@@ -133,7 +163,7 @@ int main(int argc, char* argv[])
             cur_frame++;
         }
     }
-    return 0;
+    return finish(0);
 }
 
 void save(const Mat& frame, bool bw, double resize_factor, std::string fname)
@@ -155,6 +185,8 @@ void save(const Mat& frame, bool bw, double resize_factor, std::string fname)
         cvtColor(local, local, COLOR_BGR2GRAY);
     }
 
+    static StageMetrics& stage = metrics().stage("save");
+    StageTimer timer(stage);
     imwrite(fname, local);
     std::cout << "Written succesfully" << std::endl;
 }
@@ -0,0 +1,174 @@
+#include "frame_index.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include "little_endian.hpp"
+
+namespace {
+
+const char MAGIC[4] = {'M', 'P', 'I', 'X'};
+const size_t HEADER_SIZE = 16;
+const size_t ENTRY_SIZE = 8 + 8 + 8 + 8 + 4 + 4;
+
+void putEntry(std::vector<unsigned char>& buf, const FrameEntry& entry) {
+	putU64(buf, entry.frame);
+	putF64(buf, entry.timestamp);
+	putU64(buf, entry.offset);
+	putU64(buf, entry.keyframe);
+	putU32(buf, entry.length);
+	putU32(buf, entry.polygons);
+}
+
+}
+
+std::string frameIndexName(const std::string& poly_file) {
+	return poly_file + ".idx";
+}
+
+FrameIndexWriter::~FrameIndexWriter() {
+	close();
+}
+
+bool FrameIndexWriter::open(const std::string& filename) {
+	close();
+	out.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error. Could not create " << filename << ".\n";
+		return false;
+	}
+
+	buffer.clear();
+	for (char c: MAGIC) {
+		buffer.push_back(c);
+	}
+	putU32(buffer, FRAME_INDEX_VERSION);
+	putU32(buffer, HEADER_SIZE);
+	putU32(buffer, ENTRY_SIZE);
+	return flush();
+}
+
+void FrameIndexWriter::add(const FrameEntry& entry) {
+	putEntry(buffer, entry);
+	if (buffer.size() >= FLUSH_SIZE) {
+		flush();
+	}
+}
+
+bool FrameIndexWriter::append(const std::string& filename, uint64_t base) {
+	FrameIndex part;
+	if (!part.open(filename)) return false;
+
+	for (size_t i = 0; i < part.size(); ++i) {
+		FrameEntry entry = part.entry(i);
+		entry.offset += base;
+		entry.keyframe += base;
+		add(entry);
+	}
+	return flush();
+}
+
+bool FrameIndexWriter::flush() {
+	if (!buffer.empty()) {
+		out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+		buffer.clear();
+	}
+	out.flush();
+	return bool(out);
+}
+
+void FrameIndexWriter::close() {
+	if (out.is_open()) {
+		flush();
+		out.close();
+	}
+}
+
+bool FrameIndex::open(const std::string& filename) {
+	close();
+	if (!file.open(filename)) return false;
+
+	const unsigned char* map = reinterpret_cast<const unsigned char*>(file.data());
+	const size_t size = file.size();
+	if (size < HEADER_SIZE || std::memcmp(map, MAGIC, 4) != 0) {
+		std::cerr << "Error. " << filename << " is not a frame index.\n";
+		close();
+		return false;
+	}
+	if (getU32(map + 4) > FRAME_INDEX_VERSION) {
+		std::cerr << "Error. " << filename << " is a frame index of version " << getU32(map + 4)
+			<< ", only up to " << FRAME_INDEX_VERSION << " is supported.\n";
+		close();
+		return false;
+	}
+	const size_t header_size = getU32(map + 8);
+	entry_size = getU32(map + 12);
+	if (header_size < HEADER_SIZE || header_size > size || entry_size < ENTRY_SIZE) {
+		std::cerr << "Error. " << filename << " has a corrupted header.\n";
+		close();
+		return false;
+	}
+
+	//An entry cut short by a writer that stopped is ignored
+	entries = map + header_size;
+	count = (size - header_size) / entry_size;
+	return true;
+}
+
+void FrameIndex::close() {
+	file.close();
+	entries = nullptr;
+	entry_size = count = 0;
+}
+
+FrameEntry FrameIndex::entry(size_t i) const {
+	const unsigned char* p = entries + i * entry_size;
+	FrameEntry entry;
+	entry.frame = getU64(p);
+	entry.timestamp = getF64(p + 8);
+	entry.offset = getU64(p + 16);
+	entry.keyframe = getU64(p + 24);
+	entry.length = getU32(p + 32);
+	entry.polygons = getU32(p + 36);
+	return entry;
+}
+
+bool FrameIndex::find(uint64_t frame, FrameEntry& entry) const {
+	if (count == 0) return false;
+
+	//Consecutive frames are found right away
+	const uint64_t first = getU64(entries);
+	if (frame >= first && frame - first < count) {
+		entry = this->entry(frame - first);
+		if (entry.frame == frame) return true;
+	}
+
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (getU64(entries + mid * entry_size) < frame) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == count) return false;
+	entry = this->entry(lo);
+	return entry.frame == frame;
+}
+
+bool FrameIndex::findTime(double timestamp, FrameEntry& entry) const {
+	//First entry after timestamp
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (getF64(entries + mid * entry_size + 8) <= timestamp) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) return false;
+	entry = this->entry(lo - 1);
+	return true;
+}
@@ -0,0 +1,305 @@
+#include "frame_segmenter.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#include "label_contours.hpp"
+#include "metrics.hpp"
+#include "reusable_buffer.hpp"
+
+using namespace cv;
+
+size_t largestContour(const std::vector<std::vector<Point>>& contours) {
+	size_t biggest = 0;
+	size_t biggest_size = 0;
+	for (size_t i = 0; i < contours.size(); ++i) {
+		if (contours[i].size() > biggest_size) {
+			biggest = i;
+			biggest_size = contours[i].size();
+		}
+	}
+	return biggest;
+}
+
+namespace {
+
+/** Extracts the contours of the watershed labels of mask into out. offset is
+ * the position of mask in the frame.
+ */
+void extractContours(const FilterProgram& filter, const Mat& mask, Point offset, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out) {
+	static StageMetrics& stage = metrics().stage("contours");
+	StageTimer timer(stage);
+
+	if (filter.object_count > 1) {
+		//One pass over the labels for the box of every object, then each
+		//object is traced only inside its box. Vectors of out are assigned,
+		//not rebuilt, so their memory is reused.
+		labelBoxes(mask, FilterProgram::objectLabel(filter.object_count), buffers.boxes, buffers.box_tl, buffers.box_br);
+
+		out.objects.resize(filter.object_count);
+		std::vector<std::vector<Point>>& contours = buffers.contours;
+		size_t found = 0;
+		for (int k = 1; k <= filter.object_count; ++k) {
+			std::vector<Point>& object = out.objects[k - 1];
+			object.clear();
+			const int label = FilterProgram::objectLabel(k);
+			const Rect& box = buffers.boxes[label];
+			if (box.empty()) continue;
+
+			traceLabelContours(mask(box), label, label, contours, opts.approx, offset + box.tl(), buffers.trace);
+			if (!contours.empty()) {
+				object = contours[largestContour(contours)];
+				if (found == out.contours.size()) {
+					out.contours.emplace_back();
+				}
+				out.contours[found++] = object;
+			}
+		}
+		out.contours.resize(found);
+		out.biggest = largestContour(out.contours);
+		return;
+	}
+
+	//Finds the largest contour, straight from the foreground markers
+	out.objects.clear();
+	traceLabelContours(mask, FilterProgram::FG_THRESHOLD + 1, INT_MAX, out.contours, opts.approx, offset, buffers.trace);
+	out.biggest = largestContour(out.contours);
+}
+
+/** Coarse to fine segmentation of the full frame. Labels of the reduced frame
+ * that are the same over a whole neighbourhood are kept as markers; the band
+ * around coarse boundaries is left unknown, apart from the seeds the filter
+ * itself gives at full resolution, and flooded again by watershed.
+ */
+void segmentPyramid(const FilterProgram& filter, const Mat& frame, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out) {
+	const FilterProgram& coarse = *filter.coarse();
+	const int level = filter.pyramidLevel();
+	const Rect full(Point(0, 0), frame.size());
+
+	//Coarse pass. Every level has its own buffer, of a fixed size.
+	buffers.levels.resize(level);
+	Mat reduced = frame;
+	for (int l = 0; l < level; ++l) {
+		pyrDown(reduced, buffers.levels[l]);
+		reduced = buffers.levels[l];
+	}
+	Mat& mask = buffers.coarse_markers;
+	coarse.execute(reduced, Rect(Point(0, 0), reduced.size()), mask, buffers.filter);
+	if (opts.blur > 0) {
+		int size = std::max(1, opts.blur >> level);
+		blur(reduced, buffers.coarse_proc, Size(size, size));
+		reduced = buffers.coarse_proc;
+	}
+	watershed(reduced, mask);
+
+	//Watershed marks the border of the frame as a boundary. Its pixels take
+	//the label next to them instead, so the border is only in the band where
+	//a boundary reaches it.
+	if (mask.rows > 2 && mask.cols > 2) {
+		mask.row(1).copyTo(mask.row(0));
+		mask.row(mask.rows - 2).copyTo(mask.row(mask.rows - 1));
+		mask.col(1).copyTo(mask.col(0));
+		mask.col(mask.cols - 2).copyTo(mask.col(mask.cols - 1));
+	}
+
+	//Band: labels that change within the band radius, and watershed boundaries
+	const int radius = std::max(1, (opts.band + (1 << level) - 1) >> level);
+	Mat& band = buffers.band;
+	mask.convertTo(buffers.labels, CV_16U); // Boundaries (-1) saturate to 0
+	if (buffers.kernel.rows != 2 * radius + 1) {
+		buffers.kernel = getStructuringElement(MORPH_RECT, Size(2 * radius + 1, 2 * radius + 1));
+	}
+	erode(buffers.labels, buffers.low, buffers.kernel);
+	dilate(buffers.labels, buffers.high, buffers.kernel);
+	compare(buffers.low, buffers.high, band, CMP_NE);
+	compare(buffers.low, 0, buffers.no_label, CMP_EQ);
+	bitwise_or(band, buffers.no_label, band);
+	mask.setTo(0, band);
+
+	Mat markers = reuseBuffer(buffers.markers, frame.size(), CV_32SC1);
+	resize(mask, markers, frame.size(), 0, 0, INTER_NEAREST);
+
+	//Every piece of the band is refined in its own region, so that separate
+	//objects do not make the whole frame between them be refined
+	const int pieces = connectedComponents(band, buffers.band_labels, 8, CV_32S);
+	labelBoxes(buffers.band_labels, pieces - 1, buffers.boxes, buffers.box_tl, buffers.box_br);
+	buffers.refined.clear();
+	for (int piece = 1; piece < pieces; ++piece) {
+		const Rect& coarse_box = buffers.boxes[piece];
+		if (coarse_box.empty()) continue;
+
+		//Region around the piece at full resolution, one coarse pixel larger
+		//so that its outer pixels are stable labels
+		const int scale = 1 << level;
+		Rect roi = Rect((coarse_box.x - 1) * scale, (coarse_box.y - 1) * scale,
+				(coarse_box.width + 2) * scale, (coarse_box.height + 2) * scale) & full;
+		buffers.refined.push_back(roi);
+
+		Mat seeds = reuseBuffer(buffers.seeds, roi.size(), CV_32SC1);
+		filter.execute(frame, roi, seeds, buffers.filter);
+		Mat region = markers(roi);
+		Mat unknown = reuseBuffer(buffers.unknown, roi.size(), CV_8UC1);
+		compare(region, 0, unknown, CMP_EQ);
+		seeds.copyTo(region, unknown);
+
+		//Watershed marks the outer pixels of the region as boundaries, but
+		//they are stable labels unless they are on the border of the frame
+		const Rect ring[] = {Rect(roi.x, roi.y, roi.width, 1), Rect(roi.x, roi.br().y - 1, roi.width, 1),
+			Rect(roi.x, roi.y, 1, roi.height), Rect(roi.br().x - 1, roi.y, 1, roi.height)};
+		Mat saved[4];
+		for (int i = 0; i < 4; ++i) {
+			saved[i] = reuseBuffer(buffers.ring[i], ring[i].size(), CV_32SC1);
+			markers(ring[i]).copyTo(saved[i]);
+		}
+
+		Mat proc;
+		if (opts.blur > 0) {
+			proc = reuseBuffer(buffers.proc, roi.size(), frame.type());
+			blur(frame(roi), proc, Size(opts.blur, opts.blur));
+		} else {
+			proc = frame(roi);
+		}
+		watershed(proc, region);
+
+		for (int i = 0; i < 4; ++i) {
+			saved[i].copyTo(markers(ring[i]));
+		}
+	}
+
+	//Same frame border as a full resolution watershed
+	markers.row(0).setTo(-1);
+	markers.row(markers.rows - 1).setTo(-1);
+	markers.col(0).setTo(-1);
+	markers.col(markers.cols - 1).setTo(-1);
+
+	out.roi = full;
+	extractContours(filter, markers, Point(0, 0), opts, buffers, out);
+}
+
+/** Segments the full frame, through the pyramid if the filter has one */
+void segmentFull(const FilterProgram& filter, const Mat& frame, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out) {
+	const Rect full(Point(0, 0), frame.size());
+	if (!filter.coarse()) {
+		segmentRegion(filter, frame, full, opts, buffers, out);
+		return;
+	}
+	static StageMetrics& stage = metrics().stage("pyramid");
+	StageTimer timer(stage);
+	segmentPyramid(filter, frame, opts, buffers, out);
+}
+
+/** Draws the largest contour, or the contour of every object, over the frame */
+void drawOverlay(const Mat& frame, Segmentation& out) {
+	static StageMetrics& stage = metrics().stage("overlay");
+	StageTimer timer(stage);
+	frame.convertTo(out.segmented, CV_8UC3);
+	drawContours(out.segmented, out.contours, out.objects.empty() ? out.biggest : -1, Scalar(255, 255, 255), -1);
+	addWeighted(out.segmented, 0.5, frame, 0.5, 0, out.segmented, CV_8UC3);
+}
+
+/** True if box touches a side of roi that is not also a side of the frame.
+ * Watershed marks the outer pixels of the region as boundaries, hence the 1
+ * pixel tolerance.
+ */
+bool touchesBorder(const Rect& box, const Rect& roi, const Size& frame_size) {
+	return (roi.x > 0 && box.x <= roi.x + 1)
+		|| (roi.y > 0 && box.y <= roi.y + 1)
+		|| (roi.br().x < frame_size.width && box.br().x >= roi.br().x - 1)
+		|| (roi.br().y < frame_size.height && box.br().y >= roi.br().y - 1);
+}
+
+/** Box around what is tracked: the largest contour, or every object */
+Rect trackedBox(const Segmentation& out) {
+	if (out.objects.empty()) {
+		return boundingRect(out.largest());
+	}
+	Rect box = boundingRect(out.contours[0]);
+	for (size_t i = 1; i < out.contours.size(); ++i) {
+		box |= boundingRect(out.contours[i]);
+	}
+	return box;
+}
+
+}
+
+void FrameBuffers::reserve(const FilterProgram& filter, Size frame_size, int frame_type, const SegmentOptions& opts) {
+	reuseBuffer(markers, frame_size, CV_32SC1);
+	if (opts.blur > 0) {
+		reuseBuffer(proc, frame_size, frame_type);
+	}
+	filter.reserve(this->filter);
+	trace.reserve(size_t(frame_size.width + 2) * (frame_size.height + 2));
+
+	//Regions refined in pyramid mode; the reduced levels have a fixed size
+	if (filter.coarse()) {
+		filter.coarse()->reserve(this->filter);
+		reuseBuffer(seeds, frame_size, CV_32SC1);
+		reuseBuffer(unknown, frame_size, CV_8UC1);
+		reuseBuffer(ring[0], Size(frame_size.width, 1), CV_32SC1);
+		reuseBuffer(ring[1], Size(frame_size.width, 1), CV_32SC1);
+		reuseBuffer(ring[2], Size(1, frame_size.height), CV_32SC1);
+		reuseBuffer(ring[3], Size(1, frame_size.height), CV_32SC1);
+	}
+}
+
+void segmentRegion(const FilterProgram& filter, const Mat& frame, const Rect& roi, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out) {
+	static StageMetrics& filter_stage = metrics().stage("filter");
+	static StageMetrics& watershed_stage = metrics().stage("watershed");
+
+	Mat mask = reuseBuffer(buffers.markers, roi.size(), CV_32SC1); // Mask to hold the values
+	{
+		StageTimer timer(filter_stage);
+		filter.execute(frame, roi, mask, buffers.filter);
+	}
+
+	{
+		StageTimer timer(watershed_stage);
+		Mat proc; //Region to be processed; can be blurred
+		if (opts.blur > 0) {
+			proc = reuseBuffer(buffers.proc, roi.size(), frame.type());
+			blur(frame(roi), proc, Size(opts.blur, opts.blur));
+		} else {
+			proc = frame(roi);
+		}
+
+		watershed(proc, mask);
+	}
+
+	out.roi = roi;
+	extractContours(filter, mask, roi.tl(), opts, buffers, out);
+}
+
+void segmentFrame(const FilterProgram& filter, const Mat& frame, const SegmentOptions& opts, FrameBuffers& buffers, Segmentation& out) {
+	buffers.reserve(filter, frame.size(), frame.type(), opts);
+	segmentFull(filter, frame, opts, buffers, out);
+
+	if (opts.overlay && out.found()) { // Generates the overlay
+		drawOverlay(frame, out);
+	}
+}
+
+void segmentTracked(const FilterProgram& filter, const Mat& frame, const SegmentOptions& opts, TrackState& state, FrameBuffers& buffers, Segmentation& out) {
+	buffers.reserve(filter, frame.size(), frame.type(), opts);
+	const Rect full(Point(0, 0), frame.size());
+	bool tracked = false;
+
+	if (state.valid) {
+		const int m = opts.track_margin;
+		Rect roi = Rect(state.box.x - m, state.box.y - m, state.box.width + 2 * m, state.box.height + 2 * m) & full;
+		segmentRegion(filter, frame, roi, opts, buffers, out);
+		tracked = out.found() && !touchesBorder(trackedBox(out), roi, frame.size());
+	}
+
+	if (!tracked) { //Full frame pass
+		segmentFull(filter, frame, opts, buffers, out);
+	}
+
+	state.valid = out.found();
+	if (state.valid) {
+		state.box = trackedBox(out);
+	}
+
+	if (opts.overlay && out.found()) { // Generates the overlay
+		drawOverlay(frame, out);
+	}
+}
@@ -9,6 +9,8 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "morphology.hpp"
+
 using namespace cv;
 
 const char *W_NAME = "HSV";
@@ -26,8 +28,7 @@ void recalcTolerance(int, void *) {
   // cvtColor(poly, poly, COLOR_HSV2BGR);
 
   if (iter != 0) {
-    erode(poly, poly, Mat(), Point(-1, 1), iter);
-    dilate(poly, poly, Mat(), Point(-1, 1), iter);
+    openRect(poly, poly, iter);
   }
 
   poly.convertTo(poly, CV_8UC1);
@@ -0,0 +1,171 @@
+#include "label_contours.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+
+namespace {
+
+// Freeman directions, counter-clockwise starting to the right (y grows down)
+const Point code_deltas[8] = {Point(1, 0), Point(1, -1), Point(0, -1), Point(-1, -1),
+	Point(-1, 0), Point(-1, 1), Point(0, 1), Point(1, 1)};
+
+const signed char NBD = 2; // Mark of a traced border pixel
+const signed char NBD_RIGHT = NBD | -128; // Mark of a traced pixel on the right bound of its region
+
+/** Follows the outer border starting at offset i0 of the padded buffer, as in
+ * OpenCV's icvFetchContour. Border pixels are marked so the scan does not
+ * start on them again.
+ */
+void fetchContour(signed char* img, int step, int i0, Point pt, bool simple, std::vector<Point>& out) {
+	int deltas[16];
+	const int base[8] = {1, -step + 1, -step, -step - 1, -1, step - 1, step, step + 1};
+	for (int k = 0; k < 16; ++k) {
+		deltas[k] = base[k & 7];
+	}
+
+	//Looks for the first non zero neighbour, clockwise from the left
+	int s, s_end;
+	int i1;
+	s_end = s = 4;
+	do {
+		s = (s - 1) & 7;
+		i1 = i0 + deltas[s];
+	} while (img[i1] == 0 && s != s_end);
+
+	if (s == s_end) { //Single pixel region
+		img[i0] = NBD_RIGHT;
+		out.push_back(pt);
+		return;
+	}
+
+	int i3 = i0, i4 = 0;
+	int prev_s = s ^ 4;
+	for (;;) {
+		s_end = s;
+		s = std::min(s, 15);
+
+		while (s < 15) {
+			i4 = i3 + deltas[++s];
+			if (img[i4] != 0) break;
+		}
+		s &= 7;
+
+		//Checks "right" bound
+		if (static_cast<unsigned>(s - 1) < static_cast<unsigned>(s_end)) {
+			img[i3] = NBD_RIGHT;
+		} else if (img[i3] == 1) {
+			img[i3] = NBD;
+		}
+
+		if (!simple || s != prev_s) {
+			out.push_back(pt);
+			prev_s = s;
+		}
+		pt += code_deltas[s];
+
+		if (i4 == i0 && i3 == i1) break;
+
+		i3 = i4;
+		s = (s + 4) & 7;
+	}
+}
+
+}
+
+void traceLabelContours(const Mat& labels, int lower, int upper,
+		std::vector<std::vector<Point>>& contours, int approx, Point offset) {
+	std::vector<signed char> buffer;
+	traceLabelContours(labels, lower, upper, contours, approx, offset, buffer);
+}
+
+void traceLabelContours(const Mat& labels, int lower, int upper,
+		std::vector<std::vector<Point>>& contours, int approx, Point offset,
+		std::vector<signed char>& buffer) {
+	CV_Assert(labels.type() == CV_32SC1);
+	CV_Assert(approx == CHAIN_APPROX_NONE || approx == CHAIN_APPROX_SIMPLE);
+
+	//Binary image with a 1 pixel zero border, as findContours builds internally
+	const int step = labels.cols + 2;
+	const int width = labels.cols + 1, height = labels.rows + 1; // Scan excludes the last column and row
+	buffer.assign(static_cast<size_t>(step) * (labels.rows + 2), 0);
+	for (int y = 0; y < labels.rows; ++y) {
+		const int* in = labels.ptr<int>(y);
+		signed char* out = &buffer[(y + 1) * step + 1];
+		for (int x = 0; x < labels.cols; ++x) {
+			out[x] = (in[x] >= lower && in[x] <= upper) ? 1 : 0;
+		}
+	}
+
+	//Raster scan for outer borders (Suzuki & Abe), skipping those that are
+	//inside an already traced border, as RETR_EXTERNAL does
+	signed char* img0 = buffer.data();
+	const bool simple = approx == CHAIN_APPROX_SIMPLE;
+	size_t found = 0;
+	for (int y = 1; y < height; ++y) {
+		signed char* img = img0 + y * step;
+		int lnbd = 0; // Column of the last border pixel seen on this row
+		int prev = 0, p = 0;
+
+		for (int x = 1; x < width; ++x) {
+			for (; x < width && (p = img[x]) == prev; ++x);
+			if (x >= width) break;
+
+			if (prev == 0 && p == 1) {
+				if (img[lnbd] <= 0) { //Outer border, outside of any other
+					if (found == contours.size()) {
+						contours.emplace_back();
+					}
+					contours[found].clear();
+					fetchContour(img0, step, y * step + x, Point(x - 1, y - 1) + offset, simple, contours[found++]);
+					prev = img[x];
+					continue;
+				}
+			} else if (p == 0 && prev >= 1) { //Hole border, never traced in external mode
+				if (prev & -2) lnbd = x - 1;
+			}
+
+			prev = p;
+			if (prev & -2) lnbd = x;
+		}
+	}
+
+	//findContours lists the last contour found first
+	contours.resize(found);
+	std::reverse(contours.begin(), contours.end());
+}
+
+void labelBoxes(const Mat& labels, int max_label, std::vector<Rect>& boxes) {
+	std::vector<Point> tl, br;
+	labelBoxes(labels, max_label, boxes, tl, br);
+}
+
+void labelBoxes(const Mat& labels, int max_label, std::vector<Rect>& boxes,
+		std::vector<Point>& tl, std::vector<Point>& br) {
+	CV_Assert(labels.type() == CV_32SC1 && max_label >= 0);
+
+	//Inclusive corners; min > max marks labels not seen
+	tl.assign(max_label + 1, Point(INT_MAX, INT_MAX));
+	br.assign(max_label + 1, Point(-1, -1));
+	for (int y = 0; y < labels.rows; ++y) {
+		const int* in = labels.ptr<int>(y);
+		for (int x = 0; x < labels.cols; ++x) {
+			const int l = in[x];
+			if (l < 0 || l > max_label) continue;
+			if (x < tl[l].x) tl[l].x = x;
+			if (x > br[l].x) br[l].x = x;
+			if (y < tl[l].y) tl[l].y = y;
+			br[l].y = y;
+		}
+	}
+
+	boxes.assign(max_label + 1, Rect());
+	for (int l = 0; l <= max_label; ++l) {
+		if (br[l].x >= 0) {
+			boxes[l] = Rect(tl[l].x, tl[l].y, br[l].x - tl[l].x + 1, br[l].y - tl[l].y + 1);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#include "mapped_file.hpp"
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Error. Could not open " << filename << ".\n";
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		std::cerr << "Error. Could not read " << filename << ".\n";
+		::close(fd);
+		return false;
+	}
+
+	length = info.st_size;
+	if (length > 0) {
+		void* m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m == MAP_FAILED) {
+			std::cerr << "Error. Could not map " << filename << ".\n";
+			::close(fd);
+			length = 0;
+			return false;
+		}
+		madvise(m, length, MADV_SEQUENTIAL);
+		map = static_cast<const char*>(m);
+	}
+	::close(fd); // The mapping stays valid
+	is_open = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (map) {
+		munmap(const_cast<char*>(map), length);
+	}
+	map = nullptr;
+	length = 0;
+	is_open = false;
+}
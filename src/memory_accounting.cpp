@@ -0,0 +1,179 @@
+#include "memory_accounting.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include <opencv2/core.hpp>
+
+std::atomic<bool> memory_accounting_enabled(false);
+
+namespace {
+
+/** Totals of one kind of allocation, shared by every thread */
+struct Counters {
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> bytes;
+	std::atomic<int64_t> resident;
+	std::atomic<int64_t> peak;
+	std::atomic<int64_t> window_peak; // Peak since the last takeMatPeak
+
+	AllocationStats stats() const {
+		return {count.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed),
+			resident.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed)};
+	}
+};
+
+//Zero initialized before any dynamic initialization, so new can count from the start
+Counters mat_counters;
+Counters heap_counters;
+
+thread_local uint64_t thread_bytes = 0;
+thread_local uint64_t thread_count = 0;
+thread_local uint64_t thread_mat_bytes = 0;
+thread_local uint64_t thread_mat_count = 0;
+
+void updateMax(std::atomic<int64_t>& max, int64_t value) {
+	int64_t cur = max.load(std::memory_order_relaxed);
+	while (value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+}
+
+void countAllocation(Counters& c, size_t size) {
+	thread_bytes += size;
+	++thread_count;
+	c.count.fetch_add(1, std::memory_order_relaxed);
+	c.bytes.fetch_add(size, std::memory_order_relaxed);
+	const int64_t resident = c.resident.fetch_add(size, std::memory_order_relaxed) + size;
+	updateMax(c.peak, resident);
+	updateMax(c.window_peak, resident);
+}
+
+void countFree(Counters& c, size_t size) {
+	c.resident.fetch_sub(size, std::memory_order_relaxed);
+}
+
+/** Standard OpenCV allocator, counting the data of every Mat it allocates */
+class CountingMatAllocator : public cv::MatAllocator {
+	public:
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+				cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+			cv::UMatData* u = cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+			if (u) {
+				//Mats release their data through currAllocator, so it has to be this one
+				u->currAllocator = this;
+				countAllocation(mat_counters, u->size);
+				thread_mat_bytes += u->size;
+				++thread_mat_count;
+			}
+			return u;
+		}
+
+		bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+			return cv::Mat::getStdAllocator()->allocate(u, flags, usage);
+		}
+
+		void deallocate(cv::UMatData* u) const override {
+			if (u) {
+				countFree(mat_counters, u->size);
+				cv::Mat::getStdAllocator()->deallocate(u);
+			}
+		}
+};
+
+void* allocate(std::size_t size) {
+	if (size == 0) size = 1;
+	void* p;
+	while (!(p = std::malloc(size))) {
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+	if (memoryAccountingEnabled()) {
+		countAllocation(heap_counters, malloc_usable_size(p));
+	}
+	return p;
+}
+
+void release(void* p) noexcept {
+	if (p && memoryAccountingEnabled()) {
+		countFree(heap_counters, malloc_usable_size(p));
+	}
+	std::free(p);
+}
+
+}
+
+void enableMemoryAccounting() {
+	static CountingMatAllocator allocator;
+	cv::Mat::setDefaultAllocator(&allocator);
+	memory_accounting_enabled = true;
+}
+
+AllocationStats matAllocations() {
+	return mat_counters.stats();
+}
+
+AllocationStats heapAllocations() {
+	return heap_counters.stats();
+}
+
+uint64_t threadAllocatedBytes() {
+	return thread_bytes;
+}
+
+uint64_t threadAllocationCount() {
+	return thread_count;
+}
+
+uint64_t threadMatAllocatedBytes() {
+	return thread_mat_bytes;
+}
+
+uint64_t threadMatAllocationCount() {
+	return thread_mat_count;
+}
+
+int64_t takeMatPeak() {
+	return mat_counters.window_peak.exchange(mat_counters.resident.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p) noexcept {
+	release(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	release(p);
+}
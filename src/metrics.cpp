@@ -0,0 +1,229 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+int bucketOf(int64_t ns) {
+	if (ns < 8) return ns < 0 ? 0 : int(ns);
+	int e = 63 - __builtin_clzll(uint64_t(ns));
+	return (e - 2) * 8 + int((uint64_t(ns) >> (e - 3)) & 7);
+}
+
+/** Middle of a bucket, in ns */
+double bucketValue(int bucket) {
+	if (bucket < 8) return bucket;
+	int e = bucket / 8 + 2;
+	double low = double(8 + bucket % 8) * double(uint64_t(1) << (e - 3));
+	return low + double(uint64_t(1) << (e - 3)) / 2;
+}
+
+void updateMax(std::atomic<int64_t>& max, int64_t value) {
+	int64_t cur = max.load(std::memory_order_relaxed);
+	while (value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+}
+
+double seconds(std::chrono::steady_clock::duration d) {
+	return std::chrono::duration<double>(d).count();
+}
+
+double megabytes(int64_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+void printAllocations(std::ostream& out, const char* kind, const AllocationStats& stats, uint64_t frames) {
+	out << kind << " " << stats.count << " allocations, " << megabytes(stats.bytes) << " MB";
+	if (frames > 0) {
+		out << " (" << megabytes(stats.bytes / frames) << " MB in " << stats.count / frames << " per frame)";
+	}
+	out << ", peak " << megabytes(stats.peak) << " MB, resident " << megabytes(stats.resident) << " MB";
+}
+
+std::string allocationsJson(const AllocationStats& stats, uint64_t frames) {
+	std::ostringstream out;
+	out << "{\"count\": " << stats.count
+		<< ", \"bytes\": " << stats.bytes
+		<< ", \"bytes_per_frame\": " << (frames ? stats.bytes / frames : 0)
+		<< ", \"peak_bytes\": " << stats.peak
+		<< ", \"resident_bytes\": " << stats.resident << "}";
+	return out.str();
+}
+
+/** Stage and gauge names are plain identifiers, only quotes need care */
+std::string quoted(const std::string& s) {
+	std::string q = "\"";
+	for (char c: s) {
+		if (c == '"' || c == '\\') q += '\\';
+		q += c;
+	}
+	return q + "\"";
+}
+
+}
+
+StageMetrics::StageMetrics(const std::string& name) : stage_name(name), samples(0), total(0), max(0), alloc_bytes(0), alloc_count(0) {
+	for (int i = 0; i < BUCKETS; ++i) {
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void StageMetrics::add(int64_t ns) {
+	samples.fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(ns, std::memory_order_relaxed);
+	buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	updateMax(max, ns);
+}
+
+void StageMetrics::addAllocations(uint64_t bytes, uint64_t n) {
+	alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	alloc_count.fetch_add(n, std::memory_order_relaxed);
+}
+
+double StageMetrics::percentileNs(double q) const {
+	const uint64_t n = count();
+	if (n == 0) return 0;
+	const uint64_t rank = uint64_t(q * (n - 1));
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; ++i) {
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen > rank) return std::min(bucketValue(i), double(maxNs()));
+	}
+	return maxNs();
+}
+
+GaugeMetrics::GaugeMetrics(const std::string& name) : gauge_name(name), samples(0), sum(0), max(0) {}
+
+void GaugeMetrics::sample(int64_t value) {
+	samples.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	updateMax(max, value);
+}
+
+double GaugeMetrics::mean() const {
+	const uint64_t n = count();
+	return n ? double(sum.load(std::memory_order_relaxed)) / n : 0;
+}
+
+Metrics::Metrics() : frames(0), expected(0), start(std::chrono::steady_clock::now()), last_report(start) {}
+
+StageMetrics& Metrics::stage(const std::string& name) {
+	std::lock_guard<std::mutex> lock(m);
+	for (auto& s: stages) {
+		if (s->name() == name) return *s;
+	}
+	stages.emplace_back(new StageMetrics(name));
+	return *stages.back();
+}
+
+GaugeMetrics& Metrics::gauge(const std::string& name) {
+	std::lock_guard<std::mutex> lock(m);
+	for (auto& g: gauges) {
+		if (g->name() == name) return *g;
+	}
+	gauges.emplace_back(new GaugeMetrics(name));
+	return *gauges.back();
+}
+
+void Metrics::report(std::ostream& out, bool force) {
+	std::lock_guard<std::mutex> lock(m);
+	const auto now = std::chrono::steady_clock::now();
+	if (!force && seconds(now - last_report) < interval) return;
+	last_report = now;
+
+	const double elapsed = seconds(now - start);
+	const uint64_t done = frames;
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(1) << "[" << elapsed << " s] ";
+	if (expected > 0) {
+		line << done * 100 / expected << "% ";
+	}
+	line << done << " frames, " << (elapsed > 0 ? done / elapsed : 0) << " fps";
+	line << std::setprecision(2);
+	for (const auto& s: stages) {
+		if (s->count() == 0) continue;
+		line << " | " << s->name() << " " << s->totalNs() / 1e6 / s->count() << " ms";
+	}
+	for (const auto& g: gauges) {
+		if (g->count() == 0) continue;
+		line << " | " << g->name() << " " << g->mean();
+	}
+	line << "\n";
+	if (force && memoryAccountingEnabled()) {
+		line << "Memory: ";
+		printAllocations(line, "Mat", matAllocations(), done);
+		line << " | ";
+		printAllocations(line, "heap", heapAllocations(), done);
+		for (const auto& s: stages) {
+			if (s->allocationCount() == 0) continue;
+			line << " | " << s->name() << " " << megabytes(s->allocatedBytes()) << " MB";
+		}
+		line << "\n";
+	}
+
+	//One write per report, without flushing the stream on every frame
+	out << line.str();
+}
+
+bool Metrics::writeJson(const std::string& filename, const std::string& tool) const {
+	std::lock_guard<std::mutex> lock(m);
+	std::ofstream out(filename, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error. Could not create " << filename << ".\n";
+		return false;
+	}
+
+	const double elapsed = seconds(std::chrono::steady_clock::now() - start);
+	const uint64_t done = frames;
+	out << std::setprecision(6);
+	out << "{\n";
+	out << "  \"tool\": " << quoted(tool) << ",\n";
+	out << "  \"elapsed_s\": " << elapsed << ",\n";
+	out << "  \"frames\": " << done << ",\n";
+	out << "  \"fps\": " << (elapsed > 0 ? done / elapsed : 0) << ",\n";
+	out << "  \"stages\": {";
+	bool first = true;
+	for (const auto& s: stages) {
+		const uint64_t n = s->count();
+		out << (first ? "\n" : ",\n") << "    " << quoted(s->name()) << ": {"
+			<< "\"count\": " << n
+			<< ", \"total_ms\": " << s->totalNs() / 1e6
+			<< ", \"mean_ms\": " << (n ? s->totalNs() / 1e6 / n : 0)
+			<< ", \"p50_ms\": " << s->percentileNs(0.5) / 1e6
+			<< ", \"p90_ms\": " << s->percentileNs(0.9) / 1e6
+			<< ", \"p99_ms\": " << s->percentileNs(0.99) / 1e6
+			<< ", \"max_ms\": " << s->maxNs() / 1e6;
+		if (memoryAccountingEnabled()) {
+			out << ", \"alloc_count\": " << s->allocationCount() << ", \"alloc_bytes\": " << s->allocatedBytes();
+		}
+		out << "}";
+		first = false;
+	}
+	out << (first ? "},\n" : "\n  },\n");
+	out << "  \"gauges\": {";
+	first = true;
+	for (const auto& g: gauges) {
+		out << (first ? "\n" : ",\n") << "    " << quoted(g->name()) << ": {"
+			<< "\"samples\": " << g->count()
+			<< ", \"mean\": " << g->mean()
+			<< ", \"max\": " << g->maxValue() << "}";
+		first = false;
+	}
+	out << (first ? "}" : "\n  }");
+	if (memoryAccountingEnabled()) {
+		out << ",\n  \"memory\": {\n";
+		out << "    \"mat\": " << allocationsJson(matAllocations(), done) << ",\n";
+		out << "    \"heap\": " << allocationsJson(heapAllocations(), done) << "\n";
+		out << "  }";
+	}
+	out << "\n}\n";
+	return bool(out);
+}
+
+Metrics& metrics() {
+	static Metrics instance;
+	return instance;
+}
@@ -0,0 +1,170 @@
+#include "morphology.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "reusable_buffer.hpp"
+
+using namespace cv;
+
+namespace {
+
+struct MinOp {
+	static unsigned char neutral() { return 255; } // Value of pixels outside of the image
+	unsigned char operator()(unsigned char a, unsigned char b) const { return std::min(a, b); }
+};
+
+struct MaxOp {
+	static unsigned char neutral() { return 0; }
+	unsigned char operator()(unsigned char a, unsigned char b) const { return std::max(a, b); }
+};
+
+/** Running op over windows of 2 * r + 1 pixels of every row.
+ *
+ * The padded row is cut into blocks of the window width. g holds the op of
+ * each pixel with the ones before it in its block, and h with the ones after
+ * it. A window spans at most two blocks, so it is op(h[start], g[end]).
+ */
+template <typename Op>
+void rowPass(const Mat& src, Mat& dst, int r, MorphologyBuffers& buffers) {
+	const Op op;
+	const int w = 2 * r + 1;
+	const int len = src.cols + 2 * r;
+	std::vector<unsigned char>& p = buffers.row_p;
+	std::vector<unsigned char>& g = buffers.row_g;
+	std::vector<unsigned char>& h = buffers.row_h;
+	p.assign(len, Op::neutral());
+	g.resize(len);
+	h.resize(len);
+
+	for (int y = 0; y < src.rows; ++y) {
+		const unsigned char* in = src.ptr<unsigned char>(y);
+		std::copy(in, in + src.cols, p.begin() + r);
+
+		for (int b = 0; b < len; b += w) {
+			const int end = std::min(b + w, len);
+			g[b] = p[b];
+			for (int i = b + 1; i < end; ++i) {
+				g[i] = op(g[i - 1], p[i]);
+			}
+			h[end - 1] = p[end - 1];
+			for (int i = end - 2; i >= b; --i) {
+				h[i] = op(h[i + 1], p[i]);
+			}
+		}
+
+		unsigned char* out = dst.ptr<unsigned char>(y);
+		for (int x = 0; x < src.cols; ++x) {
+			out[x] = op(h[x], g[x + w - 1]);
+		}
+	}
+}
+
+/** Same as rowPass(), over columns. Whole rows are combined at a time, so
+ * memory is read in order.
+ */
+template <typename Op>
+void colPass(const Mat& src, Mat& dst, int r, MorphologyBuffers& buffers) {
+	const Op op;
+	const int w = 2 * r + 1;
+	const int len = src.rows + 2 * r;
+	const int cols = src.cols;
+	std::vector<unsigned char>& neutral = buffers.neutral;
+	neutral.assign(cols, Op::neutral());
+	Mat g = reuseBuffer(buffers.g, Size(cols, len), CV_8UC1);
+	Mat h = reuseBuffer(buffers.h, Size(cols, len), CV_8UC1);
+
+	auto padded = [&](int i) {
+		return (i < r || i >= src.rows + r) ? neutral.data() : src.ptr<unsigned char>(i - r);
+	};
+
+	for (int b = 0; b < len; b += w) {
+		const int end = std::min(b + w, len);
+		std::copy(padded(b), padded(b) + cols, g.ptr<unsigned char>(b));
+		for (int i = b + 1; i < end; ++i) {
+			const unsigned char* prev = g.ptr<unsigned char>(i - 1);
+			const unsigned char* in = padded(i);
+			unsigned char* out = g.ptr<unsigned char>(i);
+			for (int x = 0; x < cols; ++x) {
+				out[x] = op(prev[x], in[x]);
+			}
+		}
+		std::copy(padded(end - 1), padded(end - 1) + cols, h.ptr<unsigned char>(end - 1));
+		for (int i = end - 2; i >= b; --i) {
+			const unsigned char* next = h.ptr<unsigned char>(i + 1);
+			const unsigned char* in = padded(i);
+			unsigned char* out = h.ptr<unsigned char>(i);
+			for (int x = 0; x < cols; ++x) {
+				out[x] = op(next[x], in[x]);
+			}
+		}
+	}
+
+	for (int y = 0; y < src.rows; ++y) {
+		const unsigned char* a = h.ptr<unsigned char>(y);
+		const unsigned char* b = g.ptr<unsigned char>(y + w - 1);
+		unsigned char* out = dst.ptr<unsigned char>(y);
+		for (int x = 0; x < cols; ++x) {
+			out[x] = op(a[x], b[x]);
+		}
+	}
+}
+
+template <typename Op>
+void runningRect(const Mat& src, Mat& dst, int r, MorphologyBuffers& buffers) {
+	CV_Assert(src.type() == CV_8UC1);
+	Mat rows = reuseBuffer(buffers.rows, src.size(), CV_8UC1);
+	rowPass<Op>(src, rows, r, buffers);
+	dst.create(src.size(), CV_8UC1);
+	colPass<Op>(rows, dst, r, buffers);
+}
+
+/** Square kernel equivalent to iterations of the default 3x3 one */
+const Mat& squareKernel(int iterations, MorphologyBuffers& buffers) {
+	Mat& kernel = buffers.kernels[iterations];
+	if (kernel.empty()) {
+		kernel = getStructuringElement(MORPH_RECT, Size(2 * iterations + 1, 2 * iterations + 1));
+	}
+	return kernel;
+}
+
+}
+
+void erodeRect(const Mat& src, Mat& dst, int iterations) {
+	MorphologyBuffers buffers;
+	erodeRect(src, dst, iterations, buffers);
+}
+
+void erodeRect(const Mat& src, Mat& dst, int iterations, MorphologyBuffers& buffers) {
+	if (iterations < RUNNING_MORPHOLOGY_MIN_ITERATIONS) {
+		//Same as iterations of the default kernel, which OpenCV would otherwise build on every call
+		erode(src, dst, squareKernel(iterations, buffers));
+	} else {
+		runningRect<MinOp>(src, dst, iterations, buffers);
+	}
+}
+
+void dilateRect(const Mat& src, Mat& dst, int iterations) {
+	MorphologyBuffers buffers;
+	dilateRect(src, dst, iterations, buffers);
+}
+
+void dilateRect(const Mat& src, Mat& dst, int iterations, MorphologyBuffers& buffers) {
+	if (iterations < RUNNING_MORPHOLOGY_MIN_ITERATIONS) {
+		dilate(src, dst, squareKernel(iterations, buffers));
+	} else {
+		runningRect<MaxOp>(src, dst, iterations, buffers);
+	}
+}
+
+void openRect(const Mat& src, Mat& dst, int iterations) {
+	MorphologyBuffers buffers;
+	openRect(src, dst, iterations, buffers);
+}
+
+void openRect(const Mat& src, Mat& dst, int iterations, MorphologyBuffers& buffers) {
+	erodeRect(src, dst, iterations, buffers);
+	dilateRect(dst, dst, iterations, buffers);
+}
@@ -0,0 +1,179 @@
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "cxxopts.hpp"
+#include "frame_index.hpp"
+#include "polygon_stream.hpp"
+#include "wkt_reader.hpp"
+#include "wkt_writer.hpp"
+
+using namespace cv;
+
+/** Binary polygon stream, from frame first on, to one WKT polygon per line */
+int toWkt(const std::string& input, const std::string& output, bool keys, uint64_t first) {
+	PolygonStreamReader reader;
+	if (!reader.open(input)) return 2;
+	if (first > 0 && !reader.seekFrame(first)) {
+		std::cout << "Error. " << input << " has no frame from " << first << " on.\n";
+		return 2;
+	}
+
+	std::fstream fs(output, std::fstream::out);
+	if (!fs.is_open()) {
+		std::cout << "Error. Could not create " << output << ".\n";
+		return 3;
+	}
+
+	PolygonRecord record;
+	size_t count = 0;
+	WktWriter wkt(fs);
+	while (reader.next(record)) {
+		if (keys) {
+			wkt.number(static_cast<long long>(record.frame)).text(" ").number(static_cast<long long>(record.object)).text(" ");
+		}
+		wkt.polygon(record.points);
+		wkt.text("\n");
+		++count;
+	}
+	wkt.flush();
+	if (reader.tell() != reader.end()) {
+		std::cout << "Warning. Ignored an incomplete record at the end of " << input << ".\n";
+	}
+	std::cout << "Converted " << count << " polygons.\n";
+	return 0;
+}
+
+/** WKT polygons, one per line, optionally keyed as "<frame> <object> <WKT>", to a binary stream */
+int toBinary(const std::string& input, const std::string& output, double fps, bool chain_code, int keyframes) {
+	WktReader reader;
+	if (!reader.open(input)) return 2;
+
+	PolygonStreamWriter writer;
+	if (!writer.open(output, chain_code, keyframes)) return 3;
+
+	auto start = std::chrono::steady_clock::now();
+	WktPolygon polygon;
+	uint64_t count = 0;
+	std::vector<Point> points;
+	while (reader.next(polygon)) {
+		//Lines without keys are numbered as frames
+		uint64_t frame = polygon.keyed ? polygon.frame : polygon.line;
+		++count;
+
+		//Streams keep contours as traced, without the closing vertex of WKT
+		points.clear();
+		for (const Point2d& p : polygon.points) {
+			points.emplace_back(cvRound(p.x), cvRound(p.y));
+		}
+		if (points.size() > 1 && points.front() == points.back()) {
+			points.pop_back();
+		}
+		double timestamp = fps > 0 ? frame * 1000.0 / fps : std::numeric_limits<double>::quiet_NaN();
+		writer.write(frame, timestamp, polygon.object, points);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!reader.atEnd()) {
+		return 2;
+	}
+	if (!writer.flush()) {
+		std::cout << "Error. Could not write " << output << ".\n";
+		return 3;
+	}
+	std::cout << "Converted " << count << " polygons, " << reader.size() / 1e6 << " MB of WKT at "
+		<< (seconds > 0 ? reader.size() / 1e6 / seconds : 0) << " MB/s.\n";
+	return 0;
+}
+
+/** Writes the polygons of one frame of input as WKT to std::cout, found
+ * through the index sidecar. The frame is given by index or, if it is
+ * negative, by timestamp in ms.
+ */
+int printFrame(const std::string& input, long long frame, double timestamp, bool keys, long long object) {
+	FrameIndex index;
+	if (!index.open(frameIndexName(input))) return 2;
+
+	FrameEntry entry;
+	if (frame >= 0 ? !index.find(frame, entry) : !index.findTime(timestamp, entry)) {
+		std::cout << "Error. Frame not found in the index of " << input << ".\n";
+		return 2;
+	}
+	std::cerr << "Frame " << entry.frame << " at " << entry.timestamp << " ms: " << entry.polygons << " polygons.\n";
+	if (entry.empty()) return 0;
+
+	if (!PolygonStreamReader::isStream(input)) {
+		MappedFile file;
+		if (!file.open(input) || entry.offset + entry.length > file.size()) return 2;
+		std::cout.write(file.data() + entry.offset, entry.length);
+		return 0;
+	}
+
+	//Edits are decoded from their keyframe on
+	PolygonStreamReader reader;
+	if (!reader.open(input) || !reader.seek(entry.keyframe)) return 2;
+	PolygonRecord record;
+	WktWriter wkt(std::cout);
+	while (reader.tell() < entry.offset + entry.length) {
+		const bool wanted = reader.tell() >= entry.offset;
+		if (!reader.next(record)) return 2;
+		if (!wanted || (object >= 0 && record.object != object)) continue;
+		if (keys) {
+			wkt.number(static_cast<long long>(record.frame)).text(" ").number(static_cast<long long>(record.object)).text(" ");
+		}
+		wkt.polygon(record.points);
+		wkt.text("\n");
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	cxxopts::Options options("Polygon converter", "Converts between WKT polygon files and binary polygon streams. The direction is given by the input file.");
+	options.add_options()
+		("h,help", "Shows full help")
+		("i,input", "Input file, either a binary polygon stream or a text file with one WKT polygon per line.", cxxopts::value<std::string>())
+		("o,output", "Output file.", cxxopts::value<std::string>())
+		("k,keys", "When writing WKT, prefixes each polygon with <frame> <object>, as auto_segmenter does for filters with several objects.")
+		("fps", "When writing a binary stream, computes timestamps from frame indexes at this rate. Otherwise they are unknown.", cxxopts::value<double>()->default_value("0"))
+		("chain", "When writing a binary stream, stores contours that step between neighbour pixels as Freeman chain codes.")
+		("keyframes", "When writing a binary stream, stores polygons as edits of the previous frame, with a whole keyframe every this many frames. 0 stores every polygon whole.", cxxopts::value<int>()->default_value("0"))
+		("from", "When writing WKT, starts at this frame, decoding from the keyframe before it.", cxxopts::value<uint64_t>()->default_value("0"))
+		("frame", "Prints the polygons of this frame of the input as WKT, found through its index (<input>.idx), and exits.", cxxopts::value<long long>())
+		("time", "Same as --frame, for the last frame at or before this timestamp in ms.", cxxopts::value<double>())
+		("object", "With --frame or --time on a binary stream, prints only the polygon of this object ID, such as a cell label of cell_extraction --sequence.", cxxopts::value<long long>());
+
+	if (argc==1) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+	auto result = options.parse(argc, argv);
+
+	if (result["help"].as<bool>()) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	if (result.count("input") && (result.count("frame") || result.count("time"))) {
+		return printFrame(result["input"].as<std::string>(), result.count("frame") ? result["frame"].as<long long>() : -1,
+				result.count("time") ? result["time"].as<double>() : 0, result["keys"].as<bool>(),
+				result.count("object") ? result["object"].as<long long>() : -1);
+	}
+
+	if (!result.count("input") || !result.count("output")) {
+		std::cout << "Error. Need to specify input and output files.\n";
+		return 1;
+	}
+
+	const std::string input = result["input"].as<std::string>();
+	const std::string output = result["output"].as<std::string>();
+	if (PolygonStreamReader::isStream(input)) {
+		return toWkt(input, output, result["keys"].as<bool>(), result["from"].as<uint64_t>());
+	}
+	return toBinary(input, output, result["fps"].as<double>(), result["chain"].as<bool>(), result["keyframes"].as<int>());
+}
@@ -0,0 +1,448 @@
+#include "polygon_stream.hpp"
+
+#include "chain_code.hpp"
+#include "little_endian.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+using namespace cv;
+
+namespace {
+
+const char MAGIC[4] = {'M', 'P', 'L', 'Y'};
+const size_t RECORD_FIXED_SIZE = 8 + 8 + 4 + 4 + 1; // Frame, timestamp, object, vertex count and encoding
+
+void putUVarint(std::vector<unsigned char>& buf, uint32_t v) {
+	while (v >= 0x80) {
+		buf.push_back((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	buf.push_back(v);
+}
+
+void putVarint(std::vector<unsigned char>& buf, int32_t v) {
+	putUVarint(buf, (uint32_t(v) << 1) ^ uint32_t(v >> 31)); // Zigzag: small magnitudes take few bytes
+}
+
+/** Decodes a varint of [p, end). Returns false if it does not fit. */
+bool getUVarint(const unsigned char*& p, const unsigned char* end, uint32_t& v) {
+	v = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (p == end) return false;
+		unsigned char b = *p++;
+		v |= uint32_t(b & 0x7f) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+bool getVarint(const unsigned char*& p, const unsigned char* end, int32_t& v) {
+	uint32_t z;
+	if (!getUVarint(p, end, z)) return false;
+	v = int32_t(z >> 1) ^ -int32_t(z & 1);
+	return true;
+}
+
+//Edit script operations, in the low two bits of each operation varint
+enum EditOperation {
+	EDIT_COPY = 0,
+	EDIT_SKIP = 1,
+	EDIT_INSERT = 2
+};
+
+void putEdit(std::vector<unsigned char>& buf, EditOperation op, size_t length) {
+	putUVarint(buf, uint32_t(length << 2) | op);
+}
+
+uint64_t pointKey(Point p) {
+	return (uint64_t(uint32_t(p.x)) << 32) | uint32_t(p.y);
+}
+
+/** Edit script from prev to cur, appended to buf.
+ *
+ * A greedy match in linear time rather than a minimal diff: runs of equal
+ * vertices are copied and, at a mismatch, the next vertex of cur found
+ * further along prev resynchronises both, skipping the vertices of prev in
+ * between and inserting those of cur. Contours barely move between frames,
+ * so most of the script is a few long copies.
+ */
+void encodeEdit(const std::vector<Point>& prev, const std::vector<Point>& cur, std::vector<unsigned char>& buf) {
+	//First position of every vertex of prev. Contours may pass a pixel twice.
+	std::unordered_map<uint64_t, size_t> positions;
+	positions.reserve(prev.size());
+	for (size_t k = prev.size(); k-- > 0;) {
+		positions[pointKey(prev[k])] = k;
+	}
+
+	size_t i = 0, j = 0;
+	Point last(0, 0);
+	while (j < cur.size()) {
+		size_t run = 0;
+		while (i + run < prev.size() && j + run < cur.size() && prev[i + run] == cur[j + run]) ++run;
+		if (run > 0) {
+			putEdit(buf, EDIT_COPY, run);
+			i += run;
+			j += run;
+			last = cur[j - 1];
+			continue;
+		}
+
+		//Next vertex of cur that is still ahead in prev
+		size_t k = j, match = prev.size();
+		for (; k < cur.size(); ++k) {
+			auto it = positions.find(pointKey(cur[k]));
+			if (it != positions.end() && it->second >= i) {
+				match = it->second;
+				break;
+			}
+		}
+		if (match > i) {
+			putEdit(buf, EDIT_SKIP, match - i);
+			i = match;
+		}
+		if (k > j) {
+			putEdit(buf, EDIT_INSERT, k - j);
+			for (; j < k; ++j) {
+				putVarint(buf, cur[j].x - last.x);
+				putVarint(buf, cur[j].y - last.y);
+				last = cur[j];
+			}
+		}
+	}
+}
+
+/** Applies the edit script of [p, end) to prev. Returns false if it does not
+ * produce exactly count vertices.
+ */
+bool decodeEdit(const unsigned char* p, const unsigned char* end, const std::vector<Point>& prev, uint32_t count,
+		std::vector<Point>& points) {
+	//Copied vertices come from prev and inserted ones take at least two bytes,
+	//so a larger count is corrupted and must not size the allocation
+	points.clear();
+	if (count > prev.size() + size_t(end - p) / 2) return false;
+	points.reserve(count);
+	size_t i = 0;
+	Point last(0, 0);
+	while (p < end) {
+		uint32_t op;
+		if (!getUVarint(p, end, op)) return false;
+		const size_t length = op >> 2;
+		const size_t added = (op & 3) == EDIT_SKIP ? 0 : length;
+		if (added > count - points.size()) return false;
+
+		switch (op & 3) {
+			case EDIT_COPY:
+				if (length > prev.size() - i) return false;
+				points.insert(points.end(), prev.begin() + i, prev.begin() + i + length);
+				i += length;
+				break;
+			case EDIT_SKIP:
+				if (length > prev.size() - i) return false;
+				i += length;
+				break;
+			case EDIT_INSERT:
+				for (size_t k = 0; k < length; ++k) {
+					int32_t dx, dy;
+					if (!getVarint(p, end, dx) || !getVarint(p, end, dy)) return false;
+					points.emplace_back(last.x + dx, last.y + dy);
+					last = points.back();
+				}
+				break;
+			default:
+				return false;
+		}
+		if (!points.empty()) last = points.back();
+	}
+	return points.size() == count;
+}
+
+/** End of the last complete record at or after begin */
+size_t completeRecords(const unsigned char* data, size_t begin, size_t end) {
+	size_t pos = begin;
+	while (end - pos >= 4 && end - pos - 4 >= getU32(data + pos)) {
+		pos += 4 + getU32(data + pos);
+	}
+	return pos;
+}
+
+}
+
+PolygonStreamWriter::~PolygonStreamWriter() {
+	close();
+}
+
+bool PolygonStreamWriter::open(const std::string& filename, bool chain_code, int keyframe_interval) {
+	close();
+	this->chain_code = chain_code;
+	this->keyframe_interval = keyframe_interval > 1 ? keyframe_interval : 0;
+	restart = true;
+	references.clear();
+	written = 0;
+	out.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error. Could not create " << filename << ".\n";
+		return false;
+	}
+
+	buffer.clear();
+	for (char c: MAGIC) {
+		buffer.push_back(c);
+	}
+	putU32(buffer, POLYGON_STREAM_VERSION);
+	putU32(buffer, POLYGON_STREAM_HEADER_SIZE);
+	putU32(buffer, this->keyframe_interval ? POLYGON_STREAM_TEMPORAL : 0);
+	return flush();
+}
+
+void PolygonStreamWriter::write(uint64_t frame, double timestamp, uint32_t object, const std::vector<Point>& points) {
+	if (restart || frame != last_frame) {
+		if (keyframe_interval) {
+			keyframe = restart || frames >= keyframe_interval;
+			if (keyframe) {
+				frames = 0;
+				references.clear();
+			}
+			++frames;
+		}
+		if (!keyframe_interval || keyframe) {
+			key_offset = tell();
+		}
+		restart = false;
+		last_frame = frame;
+	}
+
+	//Size is patched once the vertices are encoded
+	const size_t start = buffer.size();
+	putU32(buffer, 0);
+	putU64(buffer, frame);
+	putF64(buffer, timestamp);
+	putU32(buffer, object);
+	putU32(buffer, points.size());
+
+	//Without a keyframe interval every record can be decoded on its own
+	const size_t encoding = buffer.size();
+	const uint8_t key_flag = !keyframe_interval || keyframe ? POLYGON_KEYFRAME : 0;
+	if (chain_code && !points.empty() && isChain(points)) {
+		buffer.push_back(POLYGON_CHAIN_CODE | key_flag);
+		putVarint(buffer, points[0].x);
+		putVarint(buffer, points[0].y);
+		encodeChain(points, buffer);
+	} else {
+		buffer.push_back(POLYGON_DELTAS | key_flag);
+		Point prev(0, 0);
+		for (const Point& p: points) {
+			putVarint(buffer, p.x - prev.x);
+			putVarint(buffer, p.y - prev.y);
+			prev = p;
+		}
+	}
+
+	if (keyframe_interval) {
+		auto reference = references.find(object);
+		if (!keyframe && reference != references.end()) {
+			edit.clear();
+			encodeEdit(reference->second, points, edit);
+			if (edit.size() + 1 < buffer.size() - encoding) {
+				buffer.resize(encoding);
+				buffer.push_back(POLYGON_EDIT);
+				buffer.insert(buffer.end(), edit.begin(), edit.end());
+			}
+		}
+		references[object] = points;
+	}
+
+	const uint32_t size = buffer.size() - start - 4;
+	for (int i = 0; i < 4; ++i) {
+		buffer[start + i] = (size >> (8 * i)) & 0xff;
+	}
+
+	if (buffer.size() >= FLUSH_SIZE) {
+		flush();
+	}
+}
+
+bool PolygonStreamWriter::append(const std::string& filename) {
+	PolygonStreamReader part;
+	if (!part.open(filename)) return false;
+	if (part.temporal() && !keyframe_interval) {
+		std::cerr << "Error. " << filename << " has edit records and can only be appended to a stream with keyframes.\n";
+		return false;
+	}
+	if (!flush()) return false;
+
+	const size_t end = completeRecords(part.data(), part.begin(), part.end());
+	out.write(reinterpret_cast<const char*>(part.data() + part.begin()), end - part.begin());
+	written += end - part.begin();
+
+	//Records written after this would otherwise refer to those before it
+	restart = true;
+	references.clear();
+	return bool(out);
+}
+
+bool PolygonStreamWriter::flush() {
+	if (!buffer.empty()) {
+		out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+		written += buffer.size();
+		buffer.clear();
+	}
+	out.flush();
+	return bool(out);
+}
+
+void PolygonStreamWriter::close() {
+	if (out.is_open()) {
+		flush();
+		out.close();
+	}
+}
+
+PolygonStreamReader::~PolygonStreamReader() {
+	close();
+}
+
+bool PolygonStreamReader::open(const std::string& filename) {
+	close();
+	if (!file.open(filename)) return false;
+
+	map = reinterpret_cast<const unsigned char*>(file.data());
+	size = file.size();
+	if (size < POLYGON_STREAM_HEADER_SIZE || std::memcmp(map, MAGIC, 4) != 0) {
+		std::cerr << "Error. " << filename << " is not a polygon stream.\n";
+		close();
+		return false;
+	}
+	const uint32_t version = getU32(map + 4);
+	if (version != POLYGON_STREAM_VERSION) {
+		std::cerr << "Error. " << filename << " is a polygon stream of version " << version
+			<< ", only version " << POLYGON_STREAM_VERSION << " is supported.\n";
+		close();
+		return false;
+	}
+	header_size = getU32(map + 8);
+	if (header_size < POLYGON_STREAM_HEADER_SIZE || header_size > size) {
+		std::cerr << "Error. " << filename << " has a corrupted header.\n";
+		close();
+		return false;
+	}
+	flags = getU32(map + 12);
+	pos = header_size;
+	return true;
+}
+
+void PolygonStreamReader::close() {
+	file.close();
+	map = nullptr;
+	size = header_size = pos = 0;
+	flags = 0;
+	references.clear();
+}
+
+bool PolygonStreamReader::next(PolygonRecord& record) {
+	if (size - pos < 4) return false;
+	const uint32_t record_size = getU32(map + pos);
+	if (size - pos - 4 < record_size || record_size < RECORD_FIXED_SIZE) return false;
+
+	const unsigned char* p = map + pos + 4;
+	const unsigned char* end = p + record_size;
+	record.frame = getU64(p);
+	record.timestamp = getF64(p + 8);
+	record.object = getU32(p + 16);
+	const uint32_t count = getU32(p + 20);
+	const uint8_t encoding = p[24] & ~POLYGON_KEYFRAME;
+	p += RECORD_FIXED_SIZE;
+
+	bool valid = false;
+	if (encoding == POLYGON_EDIT) {
+		auto reference = references.find(record.object);
+		if (reference == references.end()) {
+			std::cerr << "Error. Edit record at offset " << pos << " without its reference, decoding must start at a keyframe.\n";
+			return false;
+		}
+		valid = decodeEdit(p, end, reference->second, count, record.points);
+	} else if (encoding == POLYGON_CHAIN_CODE) {
+		int32_t x, y;
+		valid = getVarint(p, end, x) && getVarint(p, end, y) && decodeChain(p, end, Point(x, y), count, record.points);
+	} else if (encoding == POLYGON_DELTAS && count <= size_t(end - p) / 2) { //Every vertex takes at least two bytes
+		record.points.resize(count);
+		Point prev(0, 0);
+		int32_t dx, dy;
+		uint32_t i = 0;
+		for (; i < count && getVarint(p, end, dx) && getVarint(p, end, dy); ++i) {
+			prev = Point(prev.x + dx, prev.y + dy);
+			record.points[i] = prev;
+		}
+		valid = i == count;
+	}
+	if (!valid) {
+		std::cerr << "Error. Corrupted polygon stream record at offset " << pos << ".\n";
+		return false;
+	}
+
+	if (temporal()) {
+		if (isKeyframe(pos) && !isKeyframe(previous)) {
+			references.clear();
+		}
+		references[record.object] = record.points;
+	}
+	previous = pos;
+	pos += 4 + record_size;
+	return true;
+}
+
+bool PolygonStreamReader::seek(size_t offset) {
+	if (offset < header_size || offset > size) return false;
+	pos = offset;
+	previous = 0;
+	references.clear();
+	return true;
+}
+
+bool PolygonStreamReader::seekFrame(uint64_t frame) {
+	if (!temporal()) {
+		//Every record decodes on its own, so only the record headers are read
+		size_t p = header_size;
+		while (isComplete(p) && frameAt(p) < frame) {
+			p += 4 + getU32(map + p);
+		}
+		seek(p);
+		return isComplete(p);
+	}
+
+	//First record of the last keyframe at or before frame
+	size_t key = header_size;
+	bool in_key = false;
+	for (size_t p = header_size; isComplete(p) && frameAt(p) <= frame; p += 4 + getU32(map + p)) {
+		const bool is_key = isKeyframe(p);
+		if (is_key && !in_key) key = p;
+		in_key = is_key;
+	}
+
+	//Decodes up to the frame
+	seek(key);
+	PolygonRecord record;
+	while (isComplete(pos) && frameAt(pos) < frame) {
+		if (!next(record)) return false;
+	}
+	return isComplete(pos);
+}
+
+uint64_t PolygonStreamReader::frameAt(size_t offset) const {
+	return getU64(map + offset + 4);
+}
+
+bool PolygonStreamReader::isKeyframe(size_t offset) const {
+	return !temporal() || (offset >= header_size && (map[offset + 4 + 24] & POLYGON_KEYFRAME));
+}
+
+bool PolygonStreamReader::isComplete(size_t offset) const {
+	return size - offset >= 4 && size - offset - 4 >= getU32(map + offset) && getU32(map + offset) >= RECORD_FIXED_SIZE;
+}
+
+bool PolygonStreamReader::isStream(const std::string& filename) {
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	char magic[4];
+	return in.read(magic, 4) && std::memcmp(magic, MAGIC, 4) == 0;
+}
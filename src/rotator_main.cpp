@@ -1,5 +1,4 @@
 #include <cmath>
-#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -9,6 +8,8 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "wkt_reader.hpp"
+
 using namespace cv;
 
 template <typename T, typename T2>
@@ -52,10 +53,10 @@ int main(int argc, char *argv[]) {
 
   polys.emplace_back();
   {
-    std::fstream fs(argv[1]);
-    int x, y;
-    while (fs >> x >> y) {
-      polys[0].emplace_back(x, y);
+    std::vector<Point2d> points;
+    readPointFile(argv[1], points);
+    for (Point2d p : points) {
+      polys[0].emplace_back(cvRound(p.x), cvRound(p.y));
     }
   }
 
@@ -76,10 +77,10 @@ int main(int argc, char *argv[]) {
 
   polys.emplace_back();
   {
-    std::fstream fs(argv[2]);
-    int x, y;
-    while (fs >> x >> y) {
-      polys[2].emplace_back(x, y);
+    std::vector<Point2d> points;
+    readPointFile(argv[2], points);
+    for (Point2d p : points) {
+      polys[2].emplace_back(cvRound(p.x), cvRound(p.y));
     }
   }
 
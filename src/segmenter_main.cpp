@@ -1,5 +1,7 @@
+#include <climits>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -7,20 +9,28 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "label_contours.hpp"
+#include "polygon_stream.hpp"
+#include "wkt_writer.hpp"
+
 using namespace cv;
 using std::string;
 using std::vector;
 
 Mat image, mask, segmented, blurred;
+Mat mask_gray, mask_bgr; // Mask as an image, for the overlay
 vector<Point> obj;
 vector<Point> background;
 int cur_obj = 0;
 const char *WHNDL = "Segmenter (press s to save, q to quit)";
 string filename;
+bool chain_code = false; // Saves a chain coded polygon stream instead of WKT
 const int blur_sz = 5;
 
 void drawMask() {
-  mask = Mat::zeros(image.size(), CV_32SC1);
+  // Reuses the mask of the previous click
+  mask.create(image.size(), CV_32SC1);
+  mask.setTo(Scalar(0));
 
   // Interest points as convex hull
   /*if (obj.size() >= 3) {
@@ -40,11 +50,11 @@ void drawMask() {
 }
 
 void genOverlay() {
-  Mat m;
-  mask.convertTo(m, CV_8UC3);
-  cvtColor(m, m, COLOR_GRAY2BGR);
+  // Separate buffers, so each click reuses them
+  mask.convertTo(mask_gray, CV_8UC1);
+  cvtColor(mask_gray, mask_bgr, COLOR_GRAY2BGR);
 
-  addWeighted(image, 0.5, m, 0.5, 0, segmented);
+  addWeighted(image, 0.5, mask_bgr, 0.5, 0, segmented);
 
   imshow(WHNDL, segmented);
   // imshow("mask", m);
@@ -52,36 +62,41 @@ void genOverlay() {
 }
 
 void generateContour() {
-  Mat binary;
-  mask.convertTo(binary, CV_32FC1);
-  threshold(binary, binary, 200, 255, THRESH_BINARY);
-  binary.convertTo(binary, CV_8UC1);
-	//imshow("Binary", binary);
   std::vector<std::vector<Point>> vertexes;
 
-  findContours(binary, vertexes, RETR_EXTERNAL, CHAIN_APPROX_NONE);
+  traceLabelContours(mask, 201, INT_MAX, vertexes, CHAIN_APPROX_NONE);
 
   std::fstream fs_pof(filename + ".pof",
                   std::fstream::in | std::fstream::out | std::fstream::trunc);
-  std::fstream fs_wkt(filename + ".wkt",
-                  std::fstream::in | std::fstream::out | std::fstream::trunc);
 
-  if (!fs_pof.is_open() || !fs_wkt.is_open()) {
+  if (!fs_pof.is_open()) {
     std::cout << "Error, could not open file\n";
     exit(3);
   }
 
-	bool first=true;
-	fs_wkt << "POLYGON ((";
-
   for (Point p : vertexes[0]) {
 		fs_pof << p.x << " " << p.y << "\n";
-		fs_wkt << (!first?", ":"") << p.x << " " << p.y;
-		first = false;
   }
 
-	fs_wkt << ", " << vertexes[0][0].x << " " << vertexes[0][0].y;
-	fs_wkt << "))\n";
+  if (chain_code) {
+    PolygonStreamWriter stream;
+    if (!stream.open(filename + ".mply", true)) {
+      exit(3);
+    }
+    stream.write(0, std::numeric_limits<double>::quiet_NaN(), 1, vertexes[0]);
+    return;
+  }
+
+  std::fstream fs_wkt(filename + ".wkt",
+                  std::fstream::in | std::fstream::out | std::fstream::trunc);
+  if (!fs_wkt.is_open()) {
+    std::cout << "Error, could not open file\n";
+    exit(3);
+  }
+
+	WktWriter wkt(fs_wkt, WKT_SPACED);
+	wkt.polygon(vertexes[0]);
+	wkt.text("\n");
 }
 
 static void onMouse(int event, int x, int y, int, void *) {
@@ -109,10 +124,12 @@ static void onMouse(int event, int x, int y, int, void *) {
 }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cout << "Wrong usage! Correct usage: ./segmenter <source image>\n";
+  if (argc != 2 && !(argc == 3 && string(argv[2]) == "chain")) {
+    std::cout << "Wrong usage! Correct usage: ./segmenter <source image> [chain]\n"
+              << "With chain, the contour is saved as a chain coded polygon stream (.mply) instead of WKT.\n";
     exit(1);
   }
+  chain_code = argc == 3;
 
   image = imread(argv[1]);
 
@@ -13,6 +13,8 @@
 #include "simplifier.hpp"
 
 #include "cxxopts.hpp"
+#include "metrics.hpp"
+#include "visvalingam.hpp"
 
 #define FACTOR 1.2 //Spacing factor
 
@@ -28,6 +30,8 @@ struct {
 } globals;
 
 void drawPolygon(Mat src, const Polygon& pol, const Scalar& color, double displace_x, double displace_y, bool drawMarkers) {
+	static StageMetrics& stage = metrics().stage("draw");
+	StageTimer timer(stage);
 	std::vector<std::vector<Point>> polys;
 	polys.emplace_back();
 	for (SimplePoint p: pol.points) {
@@ -59,10 +63,18 @@ Mat genImage(bool drawWindow) {
 	fs = std::fstream("p2_orig.wkt", std::fstream::out);
 	globals.p2.save(fs, Polygon::FileType::FILE_WKT);
 
+	static StageMetrics& vv_stage = metrics().stage("visvalingam");
+	static StageMetrics& dp_stage = metrics().stage("douglas_peucker");
+	static StageMetrics& temporal_stage = metrics().stage("temporal");
+	metrics().addFrames();
+
 	//Visvalingam
 	Polygon vv_p1 = globals.p1, vv_p2 = globals.p2;
-	Simplifier::visvalingam_until_n(vv_p1, globals.red_per);
-	Simplifier::visvalingam_until_n(vv_p2, globals.red_per);
+	{
+		StageTimer timer(vv_stage);
+		visvalingamReduce(vv_p1, globals.red_per);
+		visvalingamReduce(vv_p2, globals.red_per);
+	}
 
 	fs = std::fstream("p1_vv.wkt", std::fstream::out);
 	vv_p1.save(fs, Polygon::FileType::FILE_WKT);
@@ -78,8 +90,11 @@ Mat genImage(bool drawWindow) {
 
 	//Douglas-Peucker
 	Polygon dp_p1 = globals.p1, dp_p2 = globals.p2;
-	Simplifier::douglas_peucker_until_n(dp_p1, globals.red_per);
-	Simplifier::douglas_peucker_until_n(dp_p2, globals.red_per);
+	{
+		StageTimer timer(dp_stage);
+		Simplifier::douglas_peucker_until_n(dp_p1, globals.red_per);
+		Simplifier::douglas_peucker_until_n(dp_p2, globals.red_per);
+	}
 
 	fs = std::fstream("p1_dp.wkt", std::fstream::out);
 	dp_p1.save(fs, Polygon::FileType::FILE_WKT);
@@ -97,7 +112,10 @@ Mat genImage(bool drawWindow) {
 	mas_pols.push_back(globals.p1);
 	mas_pols.push_back(globals.p2);
 	//Simplifier::visvalingam_with_time(mas_pols, globals.red_per, globals.t_value);
-	Simplifier::douglas_with_time(mas_pols, globals.red_per, globals.t_value);
+	{
+		StageTimer timer(temporal_stage);
+		Simplifier::douglas_with_time(mas_pols, globals.red_per, globals.t_value);
+	}
 	fs = std::fstream("p1_mas.wkt", std::fstream::out);
 	mas_pols[0].save(fs, Polygon::FileType::FILE_WKT);
 	fs = std::fstream("p2_mas.wkt", std::fstream::out);
@@ -132,7 +150,8 @@ int main(int argc, char *argv[]) {
 		("q", "Mandatory. Second polygon to be simplified", cxxopts::value<std::string>())
 		("o,output", "File to save image from simplified polygons", cxxopts::value<std::string>())
 		("r", "Percentage of points to be removed, between 0 and 1", cxxopts::value<double>())
-		("t", "Time value for visvalingam-with-time method", cxxopts::value<double>());
+		("t", "Time value for visvalingam-with-time method", cxxopts::value<double>())
+		("metrics", "Writes the timings of every simplification to this JSON file at the end.", cxxopts::value<std::string>());
 	
 	if (argc==1) {
 		std::cout << options.help() << std::endl;
@@ -199,4 +218,9 @@ int main(int argc, char *argv[]) {
 		Mat img = genImage(false);
 		imwrite(result["o"].as<std::string>(), img);
 	}
+
+	metrics().report(std::cout, true);
+	if (result.count("metrics") && !metrics().writeJson(result["metrics"].as<std::string>(), "simplifier")) {
+		return 3;
+	}
 }
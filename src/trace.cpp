@@ -0,0 +1,119 @@
+#include "trace.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+std::atomic<bool> tracing_enabled(false);
+
+namespace {
+
+struct TraceEvent {
+	const char* name;
+	int64_t start_ns; // Since the start of the trace
+	int64_t duration_ns;
+	int64_t frame; // -1 if unknown
+};
+
+/** Events of one thread. Only that thread appends, and the list of buffers
+ * keeps them after it exits.
+ */
+struct ThreadBuffer {
+	int id;
+	std::string name;
+	std::vector<TraceEvent> events;
+};
+
+std::mutex buffers_mutex; // Guards the list, taken once per thread
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+const std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+
+thread_local ThreadBuffer* thread_buffer = nullptr;
+thread_local int64_t thread_frame = -1;
+
+ThreadBuffer& threadBuffer() {
+	if (!thread_buffer) {
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		buffers.emplace_back(new ThreadBuffer());
+		thread_buffer = buffers.back().get();
+		thread_buffer->id = buffers.size();
+		thread_buffer->events.reserve(1 << 14);
+	}
+	return *thread_buffer;
+}
+
+int64_t sinceStart(std::chrono::steady_clock::time_point t) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t - trace_start).count();
+}
+
+std::string quoted(const std::string& s) {
+	std::string q = "\"";
+	for (char c: s) {
+		if (c == '"' || c == '\\') q += '\\';
+		q += c;
+	}
+	return q + "\"";
+}
+
+}
+
+void enableTracing(bool enabled) {
+	tracing_enabled = enabled;
+}
+
+void traceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	threadBuffer().events.push_back({name, sinceStart(start), sinceStart(end) - sinceStart(start), thread_frame});
+}
+
+void setTraceThreadName(const std::string& name) {
+	if (tracingEnabled()) {
+		threadBuffer().name = name;
+	}
+}
+
+TraceFrame::TraceFrame(int64_t frame) : previous(thread_frame), start(std::chrono::steady_clock::now()) {
+	thread_frame = frame;
+}
+
+TraceFrame::~TraceFrame() {
+	if (tracingEnabled()) {
+		traceEvent("frame", start, std::chrono::steady_clock::now());
+	}
+	thread_frame = previous;
+}
+
+bool writeTrace(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	std::ofstream out(filename, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error. Could not create " << filename << ".\n";
+		return false;
+	}
+
+	//Times are in microseconds, with the nanoseconds as decimals
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first = true;
+	for (const auto& buffer: buffers) {
+		if (!buffer->name.empty()) {
+			out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+				<< ", \"args\": {\"name\": " << quoted(buffer->name) << "}}";
+			first = false;
+		}
+		for (const TraceEvent& e: buffer->events) {
+			out << (first ? "" : ",\n") << "{\"name\": " << quoted(e.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+				<< ", \"ts\": " << e.start_ns / 1e3 << ", \"dur\": " << e.duration_ns / 1e3;
+			if (e.frame >= 0) {
+				out << ", \"args\": {\"frame\": " << e.frame << "}";
+			}
+			out << "}";
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	return bool(out);
+}
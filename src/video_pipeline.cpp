@@ -0,0 +1,136 @@
+#include "video_pipeline.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+using namespace cv;
+
+void runPipeline(const std::function<bool(PipelineItem&)>& read,
+		const std::function<void(PipelineItem&, size_t)>& process,
+		const std::function<void(PipelineItem&)>& write,
+		size_t workers, size_t max_in_flight) {
+	if (workers == 0) workers = 1;
+	if (max_in_flight < workers) max_in_flight = workers;
+
+	BoundedQueue<PipelineItem> decoded(max_in_flight);
+	BoundedQueue<PipelineItem> processed(max_in_flight);
+	BoundedQueue<PipelineItem> recycled(max_in_flight); // Written, to be read into again
+
+	//Window of frames decoded but not written yet. Bounds both queues and the
+	//reordering buffer of the writer, even when one frame is much slower.
+	std::mutex window_m;
+	std::condition_variable window_cv;
+	size_t written = 0;
+
+	std::thread decoder([&]() {
+		setTraceThreadName("decoder");
+		static StageMetrics& wait_stage = metrics().stage("window_wait");
+		size_t index = 0;
+		while (true) {
+			{
+				StageTimer timer(wait_stage);
+				std::unique_lock<std::mutex> lock(window_m);
+				window_cv.wait(lock, [&]() { return index - written < max_in_flight; });
+			}
+
+			TraceFrame trace(index);
+			PipelineItem item;
+			recycled.tryPop(item);
+			if (!read(item)) break;
+			item.index = index++;
+			decoded.push(std::move(item));
+		}
+		decoded.close();
+	});
+
+	std::atomic<size_t> running(workers);
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < workers; ++i) {
+		pool.emplace_back([&, i]() {
+			setTraceThreadName("worker " + std::to_string(i));
+			PipelineItem item;
+			while (decoded.pop(item)) {
+				TraceFrame trace(item.index);
+				process(item, i);
+				processed.push(std::move(item));
+			}
+			if (--running == 0) processed.close();
+		});
+	}
+
+	//Ordered writer, which also samples how full each queue is
+	static GaugeMetrics& decoded_depth = metrics().gauge("decoded_queue");
+	static GaugeMetrics& processed_depth = metrics().gauge("processed_queue");
+	static GaugeMetrics& pending_depth = metrics().gauge("reorder_pending");
+	setTraceThreadName("writer");
+	std::map<size_t, PipelineItem> pending;
+	size_t next = 0;
+	PipelineItem item;
+	while (processed.pop(item)) {
+		decoded_depth.sample(decoded.size());
+		processed_depth.sample(processed.size());
+		pending_depth.sample(pending.size());
+		pending[item.index] = std::move(item);
+		for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+			{
+				TraceFrame trace(next);
+				write(it->second);
+			}
+			recycled.push(std::move(it->second));
+			pending.erase(it);
+			++next;
+
+			std::lock_guard<std::mutex> lock(window_m);
+			written = next;
+			window_cv.notify_one();
+		}
+	}
+
+	decoder.join();
+	for (std::thread& t: pool) {
+		t.join();
+	}
+}
+
+std::vector<FrameRange> splitVideo(const std::string& filename, size_t n) {
+	VideoCapture vid(filename);
+	double frame_count = vid.get(CAP_PROP_FRAME_COUNT);
+	size_t total = frame_count > 0 ? static_cast<size_t>(frame_count) : 0;
+
+	std::vector<size_t> starts(1, 0);
+	for (size_t k = 1; k < n && total > 0; ++k) {
+		size_t target = total * k / n;
+		if (!vid.set(CAP_PROP_POS_FRAMES, target)) continue;
+
+		//Keeps the position the backend actually landed on
+		double landed = vid.get(CAP_PROP_POS_FRAMES);
+		if (landed > starts.back() && landed < total) {
+			starts.push_back(static_cast<size_t>(landed));
+		}
+	}
+
+	std::vector<FrameRange> ranges;
+	for (size_t k = 0; k < starts.size(); ++k) {
+		ranges.push_back({starts[k], k + 1 < starts.size() ? starts[k + 1] : SIZE_MAX});
+	}
+	return ranges;
+}
+
+std::string partName(const std::string& filename, size_t k) {
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of('/');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return filename + ".part" + std::to_string(k);
+	}
+	return filename.substr(0, dot) + ".part" + std::to_string(k) + filename.substr(dot);
+}
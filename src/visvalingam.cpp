@@ -0,0 +1,148 @@
+#include "visvalingam.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+double triangleArea(const SimplePoint& a, const SimplePoint& b, const SimplePoint& c) {
+	return std::abs((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) / 2;
+}
+
+/** Number of points to keep out of n */
+size_t keepCount(size_t n, double reduction) {
+	const size_t removed = static_cast<size_t>(std::max(0.0, reduction) * n);
+	return std::max(removed < n ? n - removed : 0, std::min<size_t>(n, 3));
+}
+
+/** Min-heap of point indexes ordered by (area, index), which keeps the heap
+ * position of every point so its area can change in place
+ */
+class AreaHeap {
+	public:
+		explicit AreaHeap(const std::vector<double>& area) : area(area), pos(area.size(), NONE) {}
+
+		void push(size_t i) {
+			pos[i] = heap.size();
+			heap.push_back(i);
+			up(pos[i]);
+		}
+
+		size_t pop() {
+			const size_t top = heap[0];
+			move(heap.size() - 1, 0);
+			heap.pop_back();
+			pos[top] = NONE;
+			if (!heap.empty()) down(0);
+			return top;
+		}
+
+		/** Restores the order after the area of i changed */
+		void update(size_t i) {
+			if (pos[i] == NONE) return;
+			up(pos[i]);
+			down(pos[i]);
+		}
+
+		bool empty() const { return heap.empty(); }
+
+	private:
+		static const size_t NONE = static_cast<size_t>(-1);
+
+		const std::vector<double>& area;
+		std::vector<size_t> heap;
+		std::vector<size_t> pos;
+
+		bool less(size_t a, size_t b) const {
+			return area[a] < area[b] || (area[a] == area[b] && a < b);
+		}
+
+		void move(size_t from, size_t to) {
+			heap[to] = heap[from];
+			pos[heap[to]] = to;
+		}
+
+		void up(size_t k) {
+			const size_t i = heap[k];
+			while (k > 0 && less(i, heap[(k - 1) / 2])) {
+				move((k - 1) / 2, k);
+				k = (k - 1) / 2;
+			}
+			heap[k] = i;
+			pos[i] = k;
+		}
+
+		void down(size_t k) {
+			const size_t i = heap[k];
+			for (size_t c = 2 * k + 1; c < heap.size(); c = 2 * k + 1) {
+				if (c + 1 < heap.size() && less(heap[c + 1], heap[c])) ++c;
+				if (!less(heap[c], i)) break;
+				move(c, k);
+				k = c;
+			}
+			heap[k] = i;
+			pos[i] = k;
+		}
+};
+
+const size_t AreaHeap::NONE;
+
+}
+
+void visvalingamReduce(Polygon& polygon, double reduction) {
+	std::vector<SimplePoint>& points = polygon.points;
+	const size_t n = points.size();
+	const size_t keep = keepCount(n, reduction);
+	if (keep >= n) return;
+
+	std::vector<size_t> prev(n), next(n);
+	std::vector<double> area(n, 0);
+	for (size_t i = 0; i < n; ++i) {
+		prev[i] = i - 1;
+		next[i] = i + 1;
+	}
+	AreaHeap heap(area);
+	for (size_t i = 1; i + 1 < n; ++i) {
+		area[i] = triangleArea(points[i - 1], points[i], points[i + 1]);
+		heap.push(i);
+	}
+
+	std::vector<bool> removed(n, false);
+	for (size_t left = n; left > keep && !heap.empty(); --left) {
+		const size_t i = heap.pop();
+		removed[i] = true;
+		next[prev[i]] = next[i];
+		prev[next[i]] = prev[i];
+
+		//Only the neighbours' triangles changed
+		for (size_t j: {prev[i], next[i]}) {
+			if (j == 0 || j == n - 1) continue;
+			area[j] = triangleArea(points[prev[j]], points[j], points[next[j]]);
+			heap.update(j);
+		}
+	}
+
+	size_t out = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (!removed[i]) points[out++] = points[i];
+	}
+	points.resize(out);
+}
+
+void visvalingamReduceNaive(Polygon& polygon, double reduction) {
+	std::vector<SimplePoint>& points = polygon.points;
+	const size_t keep = keepCount(points.size(), reduction);
+	while (points.size() > keep && points.size() > 2) {
+		size_t min = 1;
+		double min_area = triangleArea(points[0], points[1], points[2]);
+		for (size_t i = 2; i + 1 < points.size(); ++i) {
+			const double a = triangleArea(points[i - 1], points[i], points[i + 1]);
+			if (a < min_area) {
+				min_area = a;
+				min = i;
+			}
+		}
+		points.erase(points.begin() + min);
+	}
+}
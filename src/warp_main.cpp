@@ -1,4 +1,3 @@
-#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -9,6 +8,8 @@
 #include <opencv2/calib3d.hpp>
 
 #include "cxxopts.hpp"
+#include "wkt_reader.hpp"
+#include "wkt_writer.hpp"
 
 using namespace cv;
 
@@ -54,55 +55,30 @@ int main(int argc, char* argv[]) {
 	}
 
 	std::vector<Point2d> src, dst;
-
-	//Reads source file
-	{
-		std::fstream src_file(result["s"].as<std::string>(), std::fstream::in);
-		std::string line;
-
-		while (std::getline(src_file, line)) {
-			double x, y;
-			std::stringstream ss(line);
-			ss >> x >> y;
-			src.push_back(Point2d(x, y));
-		}
-	}
-	
-	//Reads destination file
-	{
-		std::fstream dst_file(result["t"].as<std::string>(), std::fstream::in);
-		std::string line;
-
-		while (std::getline(dst_file, line)) {
-			double x, y;
-			std::stringstream ss(line);
-			ss >> x >> y;
-			dst.push_back(Point2d(x, y));
-		}
+	if (!readPointFile(result["s"].as<std::string>(), src) || !readPointFile(result["t"].as<std::string>(), dst)) {
+		return 2;
 	}
 
 	Mat m = findHomography(src, dst);
 
-	std::vector<Point2f> pol;
-	std::fstream fs(result["p"].as<std::string>(), std::fstream::in);
-	float x, y;
-	while ((fs >> x >> y)) {
-		pol.push_back(Point2f(x, y));
+	std::vector<Point2d> points;
+	if (!readPointFile(result["p"].as<std::string>(), points)) {
+		return 2;
 	}
+	std::vector<Point2f> pol(points.begin(), points.end());
 
 	std::vector<Point2f> pol2;
 
 	perspectiveTransform(pol, pol2, m);
 
-	std::cout << "POLYGON ((";
-	bool first = true;
+	std::vector<Point2d> coords;
 	for (Point2f p:pol2) {
-		if (!first)
-			std::cout << ",";
-		std::cout << std::fixed << coordx(p.x) << " " << coordy(p.y);
-		first = false;
+		coords.push_back(Point2d(coordx(p.x), coordy(p.y)));
 	}
-	std::cout << "))\n";
+
+	WktWriter wkt(std::cout, WKT_OPEN);
+	wkt.polygon(coords);
+	wkt.text("\n");
 
 	return 0;
 }
@@ -0,0 +1,230 @@
+#include "wkt_reader.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace cv;
+
+namespace {
+
+// Powers of ten that are exact doubles
+const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+void skipSpaces(const char*& p, const char* end) {
+	while (p < end && isSpace(*p)) ++p;
+}
+
+/** Parses a decimal number at p, moving p past it.
+ *
+ * Mantissas of up to 2^53 with exponents up to 22 convert exactly with a
+ * single multiplication or division, which covers pixel and map coordinates.
+ * Anything else goes through strtod, on a terminated copy of the number.
+ */
+bool parseNumber(const char*& p, const char* end, double& v) {
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0; // Significant digits in mantissa
+	int exponent = 0;
+	bool any = false, exact = true;
+	for (; p < end && isDigit(*p); ++p) {
+		any = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		} else {
+			++exponent;
+			exact = exact && *p == '0';
+		}
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && isDigit(*p); ++p) {
+			any = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				--exponent;
+			} else {
+				exact = exact && *p == '0';
+			}
+		}
+	}
+	if (!any) {
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		bool e_negative = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			e_negative = *e == '-';
+			++e;
+		}
+		if (e < end && isDigit(*e)) {
+			int value = 0;
+			for (; e < end && isDigit(*e); ++e) {
+				if (value < 100000) value = value * 10 + (*e - '0');
+			}
+			exponent += e_negative ? -value : value;
+			p = e;
+		}
+	}
+
+	if (exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+		v = exponent < 0 ? mantissa / POW10[-exponent] : mantissa * POW10[exponent];
+		if (negative) v = -v;
+		return true;
+	}
+
+	std::string copy(start, p);
+	v = std::strtod(copy.c_str(), nullptr);
+	return true;
+}
+
+bool parseInteger(const char*& p, const char* end, uint64_t& v) {
+	if (p == end || !isDigit(*p)) return false;
+	v = 0;
+	for (; p < end && isDigit(*p); ++p) {
+		v = v * 10 + (*p - '0');
+	}
+	return true;
+}
+
+bool expect(const char*& p, const char* end, const char* token) {
+	size_t n = std::strlen(token);
+	if (size_t(end - p) < n || std::memcmp(p, token, n) != 0) return false;
+	p += n;
+	return true;
+}
+
+/** Parses a line of [p, end) into polygon */
+bool parseLine(const char* p, const char* end, WktPolygon& polygon) {
+	polygon.keyed = false;
+	polygon.points.clear();
+
+	if (isDigit(*p)) {
+		uint64_t frame, object;
+		if (!parseInteger(p, end, frame)) return false;
+		skipSpaces(p, end);
+		if (!parseInteger(p, end, object)) return false;
+		skipSpaces(p, end);
+		polygon.keyed = true;
+		polygon.frame = frame;
+		polygon.object = object;
+	}
+
+	if (!expect(p, end, "POLYGON")) return false;
+	skipSpaces(p, end);
+	if (!expect(p, end, "((")) return false;
+
+	while (true) {
+		Point2d pt;
+		skipSpaces(p, end);
+		if (!parseNumber(p, end, pt.x)) return false;
+		skipSpaces(p, end);
+		if (!parseNumber(p, end, pt.y)) return false;
+		skipSpaces(p, end);
+		polygon.points.push_back(pt);
+
+		if (p < end && *p == ',') {
+			++p;
+		} else {
+			break;
+		}
+	}
+	return expect(p, end, "))");
+}
+
+}
+
+bool WktReader::open(const std::string& filename) {
+	pos = 0;
+	line = 0;
+	return file.open(filename);
+}
+
+bool WktReader::next(WktPolygon& polygon) {
+	const char* data = file.data();
+	const char* end = data + file.size();
+
+	//Skips blank lines
+	for (; pos < file.size() && (data[pos] == '\n' || isSpace(data[pos])); ++pos) {
+		line += data[pos] == '\n';
+	}
+	if (pos >= file.size()) return false;
+
+	const char* begin = data + pos;
+	const char* line_end = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+	if (!line_end) line_end = end;
+
+	if (!parseLine(begin, line_end, polygon)) {
+		std::cerr << "Error. Malformed WKT polygon at offset " << pos << ".\n";
+		return false;
+	}
+	polygon.line = line;
+	pos = line_end - data;
+	return true;
+}
+
+std::vector<size_t> WktReader::index() const {
+	std::vector<size_t> offsets;
+	const char* data = file.data();
+	const char* end = data + file.size();
+	const char* line = data;
+	while (line < end) {
+		const char* line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		if (!line_end) line_end = end;
+
+		const char* p = line;
+		skipSpaces(p, line_end);
+		if (p < line_end) {
+			offsets.push_back(line - data);
+		}
+		line = line_end + 1;
+	}
+	return offsets;
+}
+
+bool WktReader::seek(size_t offset) {
+	if (offset > file.size()) return false;
+	pos = offset;
+	line = 0;
+	return true;
+}
+
+bool readPointFile(const std::string& filename, std::vector<Point2d>& points) {
+	MappedFile file;
+	if (!file.open(filename)) return false;
+
+	const char* p = file.data();
+	const char* end = p + file.size();
+	auto skip = [&]() {
+		while (p < end && (isSpace(*p) || *p == '\n')) ++p;
+	};
+
+	points.clear();
+	while (true) {
+		Point2d pt;
+		skip();
+		if (!parseNumber(p, end, pt.x)) break;
+		skip();
+		if (!parseNumber(p, end, pt.y)) break;
+		points.push_back(pt);
+	}
+	return true;
+}
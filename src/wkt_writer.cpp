@@ -0,0 +1,95 @@
+#include "wkt_writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace cv;
+
+WktWriter::WktWriter(std::ostream& out, const WktStyle& style) : out(out), style(style) {}
+
+WktWriter::~WktWriter() {
+	flush();
+}
+
+void WktWriter::flush() {
+	if (used > 0) {
+		out.write(buffer, used);
+		written += used;
+		used = 0;
+	}
+}
+
+WktWriter& WktWriter::text(const char* s) {
+	const size_t block = BLOCK_SIZE;
+	size_t n = std::strlen(s);
+	while (n > 0) { //Text longer than a block goes in pieces
+		reserve(std::min(n, block));
+		size_t k = std::min(n, block - used);
+		std::memcpy(buffer + used, s, k);
+		used += k;
+		s += k;
+		n -= k;
+	}
+	return *this;
+}
+
+WktWriter& WktWriter::number(long long v) {
+	reserve(20);
+	unsigned long long u = v < 0 ? 0ULL - static_cast<unsigned long long>(v) : v;
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+
+	if (v < 0) buffer[used++] = '-';
+	while (n > 0) {
+		buffer[used++] = digits[--n];
+	}
+	return *this;
+}
+
+WktWriter& WktWriter::number(double v) {
+	reserve(32);
+	//Up to 15 significant digits %g already gives the shortest form, and 17
+	//always read back to the same double
+	for (int precision = 15; precision <= 17; ++precision) {
+		int n = std::snprintf(buffer + used, 32, "%.*g", precision, v);
+		if (precision == 17 || std::strtod(buffer + used, nullptr) == v) {
+			used += n;
+			break;
+		}
+	}
+	return *this;
+}
+
+template <typename P>
+void WktWriter::vertices(const std::vector<P>& points) {
+	text(style.prefix);
+	bool first = true;
+	for (const P& p: points) {
+		if (!first) text(style.separator);
+		number(p.x);
+		text(" ");
+		number(p.y);
+		first = false;
+	}
+	if (style.close_ring && !points.empty()) {
+		text(style.separator);
+		number(points[0].x);
+		text(" ");
+		number(points[0].y);
+	}
+	text("))");
+}
+
+void WktWriter::polygon(const std::vector<Point>& points) {
+	vertices(points);
+}
+
+void WktWriter::polygon(const std::vector<Point2d>& points) {
+	vertices(points);
+}
@@ -0,0 +1,54 @@
+#include "test.hpp"
+
+#include <sstream>
+
+#include "filter_program.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Checks the lookup table markers against the cvtColor/inRange reference,
+ * on the whole frame and on a region of it
+ */
+void checkAgainstReference(const std::string& filter_file, Size size) {
+	FilterProgram filter;
+	CHECK(filter.load(filter_file) == 0);
+	CHECK(filter.rasterize(size));
+
+	for (int seed = 0; seed < 3; ++seed) {
+		const Mat frame = syntheticFrame(size, seed);
+		Mat mask, reference;
+		filter.execute(frame, mask);
+		filter.executeReference(frame, reference);
+		CHECK(sameMat(mask, reference));
+
+		const Rect roi(size.width / 5, size.height / 4, size.width / 2, size.height / 3);
+		FilterProgram::Scratch scratch;
+		filter.execute(frame, roi, mask, scratch);
+		filter.executeReference(frame, roi, reference);
+		CHECK(sameMat(mask, reference));
+	}
+}
+
+}
+
+TEST(lut) {
+	//Fixed layers, plain and opened HSV rules of both kinds and two objects
+	checkAgainstReference(writeFile("lut.filter",
+			"b r 0 0 20 20\n"
+			"f h 0 0 100 100 10 255 255\n"
+			"b h 2 35 0 0 85 255 255\n"
+			"f2 h 5 100 100 100 130 255 255\n"
+			"f p 160 120\n"
+			"b h 0 0 0 0 180 60 120\n"), Size(320, 240));
+}
+
+TEST(lut16) {
+	//More than 8 HSV rules take the 16 bit table
+	std::ostringstream filter;
+	for (int k = 0; k < 12; ++k) {
+		filter << (k % 3 ? "f" : "b") << " h " << k % 2 << " " << k * 15 << " 50 50 " << k * 15 + 20 << " 255 255\n";
+	}
+	checkAgainstReference(writeFile("lut16.filter", filter.str()), Size(200, 150));
+}
@@ -0,0 +1,106 @@
+#include "test.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include "frame_segmenter.hpp"
+#include "memory_accounting.hpp"
+
+using namespace cv;
+
+namespace {
+
+// Frames a FrameBuffers segments before its buffers are expected to fit
+const size_t WARMUP_FRAMES = 2;
+
+/** Segments frames of a synthetic video with filter_text and checks that,
+ * once the warm up frames are done, no frame allocates a Mat
+ */
+void checkNoAllocation(const std::string& filter_text, int pyramid_level, const SegmentOptions& opts) {
+	const Size size(320, 240);
+	FilterProgram filter;
+	CHECK(filter.load(writeFile("segment.filter", filter_text)) == 0);
+	CHECK(filter.rasterize(size, pyramid_level));
+
+	std::vector<Mat> frames;
+	for (int seed = 0; seed < 10; ++seed) {
+		frames.push_back(syntheticFrame(size, seed));
+	}
+
+	enableMemoryAccounting();
+	FrameBuffers buffers;
+	TrackState state;
+	Segmentation out;
+	for (size_t i = 0; i < frames.size(); ++i) {
+		const uint64_t before = threadMatAllocationCount();
+		if (opts.track_margin >= 0) {
+			segmentTracked(filter, frames[i], opts, state, buffers, out);
+		} else {
+			segmentFrame(filter, frames[i], opts, buffers, out);
+		}
+		CHECK(out.found());
+		CHECK(i < WARMUP_FRAMES || threadMatAllocationCount() == before);
+	}
+}
+
+//Red object against everything else
+const char* RED_FILTER =
+	"f h 0 0 100 100 10 255 255\n"
+	"b h 2 35 0 0 180 255 255\n";
+
+}
+
+TEST(reuse_buffers) {
+	SegmentOptions opts;
+	checkNoAllocation(RED_FILTER, 0, opts);
+
+	opts.blur = 5;
+	opts.overlay = true;
+	checkNoAllocation(RED_FILTER, 0, opts);
+}
+
+TEST(reuse_buffers_tracked) {
+	SegmentOptions opts;
+	opts.track_margin = 20;
+	checkNoAllocation(RED_FILTER, 0, opts);
+}
+
+TEST(reuse_buffers_pyramid) {
+	SegmentOptions opts;
+	checkNoAllocation(RED_FILTER, 1, opts);
+}
+
+TEST(reuse_buffers_objects) {
+	SegmentOptions opts;
+	checkNoAllocation(
+		"f h 0 0 100 100 10 255 255\n"
+		"f2 h 0 45 100 100 75 255 255\n"
+		"b h 0 0 0 0 180 255 99\n"
+		"b h 0 90 0 0 180 255 255\n", 0, opts);
+}
+
+TEST(pyramid_band) {
+	//A single small object only has its own surroundings refined at full
+	//resolution
+	const Size size(320, 240);
+	Mat frame(size, CV_8UC3, Scalar(128, 128, 128));
+	circle(frame, Point(100, 80), 10, Scalar(0, 0, 255), FILLED);
+
+	FilterProgram filter;
+	CHECK(filter.load(writeFile("segment.filter", RED_FILTER)) == 0);
+	CHECK(filter.rasterize(size, 1));
+
+	SegmentOptions opts;
+	FrameBuffers buffers;
+	Segmentation out;
+	segmentFrame(filter, frame, opts, buffers, out);
+	CHECK(out.found());
+	const Rect box = boundingRect(out.largest());
+	CHECK(box.width >= 18 && box.height >= 18 && (box & Rect(88, 68, 25, 25)) == box);
+
+	int refined_area = 0;
+	for (const Rect& roi: buffers.refined) {
+		refined_area += roi.area();
+	}
+	CHECK(!buffers.refined.empty());
+	CHECK(refined_area < size.area() / 4);
+}
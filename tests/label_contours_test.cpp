@@ -0,0 +1,82 @@
+#include "test.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#include <opencv2/imgproc.hpp>
+
+#include "filter_program.hpp"
+#include "label_contours.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Label image like the watershed markers: background and unknown labels
+ * under FG_THRESHOLD, objects above it, with holes, nested blobs, single
+ * pixels and shapes touching the border
+ */
+Mat syntheticLabels(Size size, int seed) {
+	Mat labels(size, CV_32SC1);
+	RNG rng(seed);
+	for (int y = 0; y < size.height; ++y) {
+		int* row = labels.ptr<int>(y);
+		for (int x = 0; x < size.width; ++x) {
+			row[x] = rng.uniform(0, FilterProgram::FG_THRESHOLD + 1);
+		}
+	}
+
+	for (int k = 0; k < 12; ++k) {
+		const Point centre(rng.uniform(0, size.width), rng.uniform(0, size.height));
+		const Size axes(rng.uniform(1, size.width / 5), rng.uniform(1, size.height / 5));
+		ellipse(labels, centre, axes, rng.uniform(0, 180), 0, 360, Scalar(FilterProgram::objectLabel(1 + k % 3)), FILLED);
+		if (k % 4 == 0) {
+			//Hole with an island inside
+			ellipse(labels, centre, Size(axes.width / 2, axes.height / 2), 0, 0, 360, Scalar(0), FILLED);
+			labels.at<int>(std::min(std::max(centre.y, 0), size.height - 1), std::min(std::max(centre.x, 0), size.width - 1)) = 255;
+		}
+	}
+	for (int k = 0; k < 20; ++k) {
+		labels.at<int>(rng.uniform(0, size.height), rng.uniform(0, size.width)) = 255;
+	}
+	return labels;
+}
+
+/** Contours of the labels in [lower, upper] the way findContours gives them */
+std::vector<std::vector<Point>> referenceContours(const Mat& labels, int lower, int upper, int approx, Point offset) {
+	Mat binary;
+	inRange(labels, Scalar(lower), Scalar(upper), binary);
+	std::vector<std::vector<Point>> contours;
+	findContours(binary, contours, RETR_EXTERNAL, approx, offset);
+	return contours;
+}
+
+void checkTraced(int approx) {
+	std::vector<signed char> buffer;
+	std::vector<std::vector<Point>> traced;
+	for (int seed = 0; seed < 8; ++seed) {
+		const Mat labels = syntheticLabels(Size(160 + seed, 120 - seed), seed);
+
+		//Foreground markers over the whole image, as in segmentFrame
+		traceLabelContours(labels, FilterProgram::FG_THRESHOLD + 1, INT_MAX, traced, approx);
+		CHECK(traced == referenceContours(labels, FilterProgram::FG_THRESHOLD + 1, INT_MAX, approx, Point()));
+
+		//A single object inside a region of the image, with the buffer and
+		//point vectors reused
+		const Rect box(seed * 3, seed * 2, 100, 70);
+		const Point offset(box.tl() + Point(5, -2));
+		const int label = FilterProgram::objectLabel(1 + seed % 3);
+		traceLabelContours(labels(box), label, label, traced, approx, offset, buffer);
+		CHECK(traced == referenceContours(labels(box), label, label, approx, offset));
+	}
+}
+
+}
+
+TEST(contours_none) {
+	checkTraced(CHAIN_APPROX_NONE);
+}
+
+TEST(contours_simple) {
+	checkTraced(CHAIN_APPROX_SIMPLE);
+}
@@ -0,0 +1,51 @@
+#include "test.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include "morphology.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Binary mask like the HSV rules give, with speckles, and a grey level ramp */
+std::vector<Mat> planes() {
+	Mat hsv, mask;
+	cvtColor(syntheticFrame(Size(181, 97), 1), hsv, COLOR_BGR2HSV);
+	inRange(hsv, Scalar(0, 100, 100), Scalar(180, 255, 255), mask);
+	RNG rng(7);
+	for (int k = 0; k < 300; ++k) {
+		mask.at<unsigned char>(rng.uniform(0, mask.rows), rng.uniform(0, mask.cols)) ^= 255;
+	}
+
+	Mat grey(60, 45, CV_8UC1);
+	rng.fill(grey, RNG::UNIFORM, 0, 256);
+	return {mask, grey, mask(Rect(13, 7, 120, 61)), mask(Rect(0, 0, 5, 3))};
+}
+
+}
+
+TEST(morphology) {
+	//Both sides of RUNNING_MORPHOLOGY_MIN_ITERATIONS, and windows larger than the image
+	const int counts[] = {1, 2, 3, 4, 5, 8, 13, 40};
+	MorphologyBuffers buffers;
+	for (const Mat& plane: planes()) {
+		for (int n: counts) {
+			Mat reference, result;
+			erode(plane, reference, Mat(), Point(-1, -1), n);
+			erodeRect(plane, result, n, buffers);
+			CHECK(sameMat(result, reference));
+
+			dilate(plane, reference, Mat(), Point(-1, -1), n);
+			dilateRect(plane, result, n, buffers);
+			CHECK(sameMat(result, reference));
+
+			//In place, as the filters open their planes
+			erode(plane, reference, Mat(), Point(-1, -1), n);
+			dilate(reference, reference, Mat(), Point(-1, -1), n);
+			plane.copyTo(result);
+			openRect(result, result, n, buffers);
+			CHECK(sameMat(result, reference));
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#include "test.hpp"
+
+#include <cmath>
+
+#include "polygon_stream.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Contour of object in frame: a traced ellipse that grows with the frame and
+ * loses a few vertices every fifth frame, so edits have something to skip and
+ * insert. Object 4 is a polygon with long steps and negative coordinates,
+ * which cannot be written as chain codes.
+ */
+std::vector<Point> syntheticPolygon(uint64_t frame, uint32_t object) {
+	std::vector<Point> points;
+	if (object == 4) {
+		RNG rng(frame);
+		for (int k = 0; k < 40; ++k) {
+			points.push_back(Point(rng.uniform(-5000, 5000), rng.uniform(-5000, 5000)));
+		}
+		return points;
+	}
+
+	const double rx = 60 + object * 20 + frame % 7, ry = 40 + object * 10;
+	const Point centre(300, 300 + object * 50);
+	for (int a = 0; a < 3600; ++a) {
+		const Point p(centre.x + int(rx * std::cos(a * CV_PI / 1800)), centre.y + int(ry * std::sin(a * CV_PI / 1800)));
+		if (points.empty() || points.back() != p) {
+			points.push_back(p);
+		}
+	}
+	if ((frame + object) % 5 == 0) {
+		points.erase(points.begin() + 10, points.begin() + 30);
+	}
+	return points;
+}
+
+/** Frames 0 to 59 with objects 1 to 4; object 3 is missing from some frames */
+bool present(uint64_t frame, uint32_t object) {
+	return object != 3 || frame % 4 != 1;
+}
+
+void writeStream(const std::string& filename, bool chain_code, int keyframe_interval, uint64_t first, uint64_t last) {
+	PolygonStreamWriter writer;
+	CHECK(writer.open(filename, chain_code, keyframe_interval));
+	for (uint64_t frame = first; frame < last; ++frame) {
+		for (uint32_t object = 1; object <= 4; ++object) {
+			if (present(frame, object)) {
+				writer.write(frame, frame * 40.0, object, syntheticPolygon(frame, object));
+			}
+		}
+	}
+	CHECK(writer.flush());
+}
+
+/** Reads the whole stream back, then seeks to some frames and checks the
+ * records that follow
+ */
+void checkStream(const std::string& filename, uint64_t frames) {
+	PolygonStreamReader reader;
+	CHECK(reader.open(filename));
+	PolygonRecord record;
+	size_t records = 0;
+	while (reader.next(record)) {
+		CHECK(record.timestamp == record.frame * 40.0);
+		CHECK(record.points == syntheticPolygon(record.frame, record.object));
+		++records;
+	}
+	CHECK(reader.tell() == reader.end());
+	size_t expected = 0;
+	for (uint64_t frame = 0; frame < frames; ++frame) {
+		for (uint32_t object = 1; object <= 4; ++object) {
+			expected += present(frame, object);
+		}
+	}
+	CHECK(records == expected);
+
+	const uint64_t seeks[] = {0, 5, 10, 11, 37, frames - 1, 7};
+	for (uint64_t frame: seeks) {
+		CHECK(reader.seekFrame(frame));
+		for (int k = 0; k < 6 && reader.next(record); ++k) {
+			CHECK(k > 0 || (record.frame == frame && record.object == 1));
+			CHECK(record.points == syntheticPolygon(record.frame, record.object));
+		}
+	}
+	CHECK(!reader.seekFrame(frames));
+}
+
+}
+
+TEST(polygon_stream) {
+	//Deltas, chain codes, and both as edits between keyframes
+	const int intervals[] = {0, 10};
+	for (int keyframe_interval: intervals) {
+		for (int chain_code = 0; chain_code < 2; ++chain_code) {
+			writeStream("test.mply", chain_code, keyframe_interval, 0, 60);
+			checkStream("test.mply", 60);
+
+			PolygonStreamReader reader;
+			CHECK(reader.open("test.mply"));
+			CHECK(reader.temporal() == (keyframe_interval > 1));
+		}
+	}
+}
+
+TEST(polygon_stream_append) {
+	//Parts written separately, as the stitching of parallel workers does
+	writeStream("part0.mply", true, 10, 0, 25);
+	writeStream("part1.mply", true, 10, 25, 60);
+	PolygonStreamWriter writer;
+	CHECK(writer.open("stitched.mply", true, 10));
+	CHECK(writer.append("part0.mply"));
+	CHECK(writer.append("part1.mply"));
+	writer.close();
+	checkStream("stitched.mply", 60);
+
+	//Edits cannot go into a stream that is not temporal
+	CHECK(writer.open("plain.mply"));
+	CHECK(!writer.append("part0.mply"));
+}
@@ -0,0 +1,48 @@
+#ifndef TEST_HPP
+#define TEST_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/** Minimal test registry for unit_tests. TEST(name) defines a test run by
+ * "unit_tests name" (or by "unit_tests" with every other test), CHECK records
+ * a failure and lets the test go on.
+ */
+struct TestCase {
+	const char* name;
+	void (*run)();
+};
+
+std::vector<TestCase>& testCases();
+
+struct TestRegistration {
+	TestRegistration(const char* name, void (*run)()) { testCases().push_back({name, run}); }
+};
+
+void reportFailure(const char* file, int line, const std::string& what);
+
+#define TEST(name) \
+	void name(); \
+	TestRegistration name##_registration(#name, name); \
+	void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) reportFailure(__FILE__, __LINE__, #condition); \
+	} while (0)
+
+/** BGR frame of size with a noisy gradient background and coloured ellipses
+ * whose position depends on seed, so consecutive seeds look like frames of a
+ * video with moving objects
+ */
+cv::Mat syntheticFrame(cv::Size size, int seed);
+
+/** Writes content to filename in the working directory and returns its name */
+std::string writeFile(const std::string& filename, const std::string& content);
+
+/** True if a and b have the same size, type and values */
+bool sameMat(const cv::Mat& a, const cv::Mat& b);
+
+#endif
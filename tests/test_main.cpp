@@ -0,0 +1,75 @@
+#include "test.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+
+namespace {
+
+int failures = 0;
+
+}
+
+std::vector<TestCase>& testCases() {
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+void reportFailure(const char* file, int line, const std::string& what) {
+	std::cerr << file << ":" << line << ": check failed: " << what << "\n";
+	++failures;
+}
+
+Mat syntheticFrame(Size size, int seed) {
+	Mat frame(size, CV_8UC3);
+	RNG rng(12345);
+	for (int y = 0; y < size.height; ++y) {
+		Vec3b* row = frame.ptr<Vec3b>(y);
+		for (int x = 0; x < size.width; ++x) {
+			row[x] = Vec3b(60 + x * 60 / size.width + rng.uniform(0, 8), 90 + rng.uniform(0, 8), 40 + y * 40 / size.height);
+		}
+	}
+
+	//Red, green and blue objects drifting a few pixels per frame
+	const Scalar colours[] = {Scalar(30, 30, 220), Scalar(40, 200, 40), Scalar(210, 60, 20)};
+	for (int k = 0; k < 3; ++k) {
+		const Point centre(size.width * (k + 1) / 4 + 3 * seed, size.height / 2 + (k - 1) * size.height / 5 + 2 * seed);
+		ellipse(frame, centre, Size(size.width / 10 + k * 3, size.height / 8), 15 * k + seed, 0, 360, colours[k], FILLED);
+	}
+	return frame;
+}
+
+std::string writeFile(const std::string& filename, const std::string& content) {
+	std::ofstream out(filename, std::ios::out | std::ios::trunc);
+	out << content;
+	return filename;
+}
+
+bool sameMat(const Mat& a, const Mat& b) {
+	return a.size() == b.size() && a.type() == b.type() && (a.empty() || norm(a, b, NORM_INF) == 0);
+}
+
+int main(int argc, char** argv) {
+	int run = 0;
+	for (const TestCase& test: testCases()) {
+		bool selected = argc == 1;
+		for (int i = 1; i < argc; ++i) {
+			selected = selected || std::strcmp(argv[i], test.name) == 0;
+		}
+		if (!selected) continue;
+
+		const int before = failures;
+		test.run();
+		std::cout << (failures == before ? "passed " : "FAILED ") << test.name << "\n";
+		++run;
+	}
+	if (run == 0) {
+		std::cerr << "Error. No test matches the arguments.\n";
+		return 2;
+	}
+	return failures ? 1 : 0;
+}
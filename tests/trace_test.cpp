@@ -0,0 +1,57 @@
+#include "test.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace {
+
+size_t occurrences(const std::string& text, const std::string& pattern) {
+	size_t n = 0;
+	for (size_t p = text.find(pattern); p != std::string::npos; p = text.find(pattern, p + 1)) {
+		++n;
+	}
+	return n;
+}
+
+}
+
+TEST(trace) {
+	StageMetrics stage("traced_stage");
+
+	//Nothing is recorded while tracing is disabled
+	{
+		TraceFrame frame(3);
+		StageTimer timer(stage);
+	}
+
+	enableTracing();
+	setTraceThreadName("main");
+	{
+		TraceFrame frame(7);
+		StageTimer timer(stage);
+	}
+	std::thread worker([&stage]() {
+		setTraceThreadName("worker \"1\"");
+		StageTimer timer(stage);
+	});
+	worker.join();
+	enableTracing(false);
+
+	CHECK(writeTrace("test.trace.json"));
+	std::ifstream in("test.trace.json");
+	std::stringstream json;
+	json << in.rdbuf();
+	const std::string trace = json.str();
+
+	CHECK(trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [") == 0);
+	CHECK(occurrences(trace, "{\"name\": \"traced_stage\", \"ph\": \"X\"") == 2);
+	CHECK(occurrences(trace, "{\"name\": \"frame\", \"ph\": \"X\"") == 1);
+	CHECK(occurrences(trace, "\"args\": {\"frame\": 7}") == 2);
+	CHECK(occurrences(trace, "\"args\": {\"frame\": 3}") == 0);
+	CHECK(trace.find("\"args\": {\"name\": \"worker \\\"1\\\"\"}") != std::string::npos);
+	CHECK(stage.count() == 3);
+}
@@ -0,0 +1,65 @@
+#include "test.hpp"
+
+#include <random>
+
+#include "simplifier.hpp"
+#include "visvalingam.hpp"
+
+namespace {
+
+/** Closed random walk of n points. Integer steps, as contours have, give
+ * many ties of area; real steps give none.
+ */
+Polygon randomPolygon(size_t n, unsigned seed, bool integer) {
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<int> step(-3, 3);
+	std::uniform_real_distribution<double> real_step(-3, 3);
+	Polygon polygon;
+	SimplePoint p;
+	p.x = 0;
+	p.y = 0;
+	for (size_t k = 0; k < n; ++k) {
+		p.x += integer ? step(rng) : real_step(rng);
+		p.y += integer ? step(rng) : real_step(rng);
+		polygon.points.push_back(p);
+	}
+	return polygon;
+}
+
+bool samePoints(const Polygon& a, const Polygon& b) {
+	if (a.points.size() != b.points.size()) return false;
+	for (size_t k = 0; k < a.points.size(); ++k) {
+		if (a.points[k].x != b.points[k].x || a.points[k].y != b.points[k].y) return false;
+	}
+	return true;
+}
+
+/** Checks visvalingamReduce() against reference on polygons of every size
+ * and reduction, including the sizes where at most 3 points are kept
+ */
+void checkAgainst(void (*reference)(Polygon&, double)) {
+	const size_t sizes[] = {3, 4, 5, 10, 57, 400};
+	const double reductions[] = {0, 0.1, 0.5, 0.9, 1};
+	for (size_t n: sizes) {
+		for (double reduction: reductions) {
+			for (unsigned seed = 0; seed < 6; ++seed) {
+				const Polygon original = randomPolygon(n, seed, seed % 2 == 0);
+				Polygon fast = original, expected = original;
+				visvalingamReduce(fast, reduction);
+				reference(expected, reduction);
+				CHECK(samePoints(fast, expected));
+			}
+		}
+	}
+}
+
+}
+
+TEST(visvalingam_naive) {
+	checkAgainst(visvalingamReduceNaive);
+}
+
+TEST(visvalingam_simplifier) {
+	//The reduction simplifier used before visvalingamReduce()
+	checkAgainst(Simplifier::visvalingam_until_n);
+}
@@ -0,0 +1,153 @@
+#include "test.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "wkt_reader.hpp"
+#include "wkt_writer.hpp"
+
+using namespace cv;
+
+namespace {
+
+/** Random walk like a contour of a large object, in pixels and in map units */
+void syntheticWalk(size_t vertices, std::vector<Point>& points, std::vector<Point2d>& real_points) {
+	RNG rng(1);
+	Point p(100000, 100000);
+	points.resize(vertices);
+	real_points.resize(vertices);
+	for (size_t i = 0; i < vertices; ++i) {
+		p += Point(rng.uniform(-1, 2), rng.uniform(-1, 2));
+		points[i] = i % 97 ? p : -p;
+		real_points[i] = Point2d(615202.199 + p.x * 0.187, 4583991.175 - p.y * 0.187);
+	}
+	real_points[1] = Point2d(0, -0.0);
+	real_points[2] = Point2d(1e-300, 123456789012345678.0);
+}
+
+template <typename P> std::string streamPolygon(const std::vector<P>& points) {
+	std::ostringstream out;
+	out.precision(17);
+	out << "POLYGON ((";
+	for (size_t i = 0; i < points.size(); ++i) {
+		out << (i ? ", " : "") << points[i].x << " " << points[i].y;
+	}
+	out << ", " << points[0].x << " " << points[0].y << "))";
+	return out.str();
+}
+
+/** Coordinates of a WKT_SPACED polygon, read with strtod */
+std::vector<Point2d> parsePolygon(const std::string& wkt) {
+	std::vector<Point2d> points;
+	const char* p = wkt.c_str() + std::strlen(WKT_SPACED.prefix);
+	char* end = nullptr;
+	while (*p && *p != ')') {
+		Point2d v;
+		v.x = std::strtod(p, &end);
+		v.y = std::strtod(end, &end);
+		points.push_back(v);
+		p = end + (*end == ',' ? 1 : 0);
+	}
+	return points;
+}
+
+}
+
+TEST(wkt_writer) {
+	std::vector<Point> points;
+	std::vector<Point2d> real_points;
+	syntheticWalk(20000, points, real_points);
+
+	//Integers exactly as iostream writes them, across several blocks
+	std::ostringstream written;
+	{
+		WktWriter writer(written, WKT_SPACED);
+		writer.polygon(points);
+	}
+	CHECK(written.str() == streamPolygon(points));
+
+	//Doubles read back to the same values
+	written.str("");
+	{
+		WktWriter writer(written, WKT_SPACED);
+		writer.polygon(real_points);
+	}
+	std::vector<Point2d> closed(real_points);
+	closed.push_back(real_points[0]);
+	CHECK(parsePolygon(written.str()) == closed);
+
+	//Other styles
+	const std::vector<Point> triangle = {Point(0, 0), Point(-10, 5), Point(3, 2147483647)};
+	written.str("");
+	{
+		WktWriter writer(written, WKT_COMPACT);
+		writer.polygon(triangle);
+		writer.text("\n");
+	}
+	CHECK(written.str() == "POLYGON((0 0,-10 5,3 2147483647,0 0))\n");
+	written.str("");
+	{
+		WktWriter writer(written, WKT_OPEN);
+		writer.polygon(triangle);
+		CHECK(writer.tell() == std::strlen("POLYGON ((0 0,-10 5,3 2147483647))"));
+	}
+	CHECK(written.str() == "POLYGON ((0 0,-10 5,3 2147483647))");
+}
+
+TEST(wkt_reader) {
+	std::vector<Point> points;
+	std::vector<Point2d> real_points;
+	syntheticWalk(5000, points, real_points);
+
+	//Polygons as every tool writes them, keyed lines and blank lines
+	std::ostringstream file;
+	{
+		WktWriter writer(file, WKT_SPACED);
+		writer.polygon(real_points);
+		writer.text("\n\n");
+		writer.number(12).text(" ").number(3).text(" ");
+		writer.polygon(points);
+		writer.text("\n");
+	}
+	{
+		WktWriter writer(file, WKT_COMPACT);
+		writer.polygon(points);
+		writer.text("\n");
+	}
+	file << "  POLYGON ((1.5e3 -0.25, 12345678901234567890123 4.000000000000000000001e-5, +7 0.1))\n";
+	file << "POLYGON ((1 2, 3\n";
+	writeFile("test.wkt", file.str());
+
+	WktReader reader;
+	CHECK(reader.open("test.wkt"));
+	WktPolygon polygon;
+	std::vector<Point2d> closed(real_points);
+	closed.push_back(real_points[0]);
+	CHECK(reader.next(polygon));
+	CHECK(!polygon.keyed && polygon.line == 0 && polygon.points == closed);
+
+	std::vector<Point2d> int_points(points.begin(), points.end());
+	int_points.push_back(int_points[0]);
+	CHECK(reader.next(polygon));
+	CHECK(polygon.keyed && polygon.frame == 12 && polygon.object == 3 && polygon.line == 2);
+	CHECK(polygon.points == int_points);
+	CHECK(reader.next(polygon));
+	CHECK(!polygon.keyed && polygon.line == 3 && polygon.points == int_points);
+
+	//Numbers the fast path does not take go through strtod
+	const std::vector<Point2d> odd = {Point2d(1500, -0.25), Point2d(std::strtod("12345678901234567890123", nullptr),
+		std::strtod("4.000000000000000000001e-5", nullptr)), Point2d(7, 0.1)};
+	CHECK(reader.next(polygon));
+	CHECK(polygon.points == odd);
+
+	//Unterminated polygon
+	CHECK(!reader.next(polygon));
+	CHECK(!reader.atEnd());
+
+	//Random access through the index
+	const std::vector<size_t> offsets = reader.index();
+	CHECK(offsets.size() == 5);
+	CHECK(offsets.size() == 5 && reader.seek(offsets[3]) && reader.next(polygon) && polygon.points == odd && polygon.line == 0);
+	CHECK(offsets.size() == 5 && reader.seek(offsets[1]) && reader.next(polygon) && polygon.frame == 12);
+}